@@ -1,7 +1,10 @@
 #!/usr/bin/sh
 rm -f -- libdesktop.so rwm
 separatelib=0
+check=1
+bench=0
 args="-O3"
+defines=""
 for i in "$@"
 do
 	if [ "$i" = "DEBUG" ]; then
@@ -10,16 +13,68 @@ do
 		separatelib=1
 	elif [ "$i" = "SIZE" ]; then
 		args="-Os -fuse-ld=gold -s"
+	elif [ "$i" = "NOURING" ]; then
+		defines="-DRWM_NO_IO_URING"
+	elif [ "$i" = "NOCHECK" ]; then
+		check=0
+	elif [ "$i" = "BENCH" ]; then
+		bench=1
 	fi
 done
+sources="rwm.cpp windows.cpp events.cpp input.cpp threadpool.cpp uring.cpp vtparser.cpp output.cpp charencoding.cpp"
 
 (
 	cd ./source || exit 1
 
 	if [ $separatelib = 1 ]; then
 		g++ --std=c++17 -shared -o ../libdesktop.so -fPIC desktop.cpp 
-		g++ --std=c++17 $args rwm.cpp windows.cpp charencoding.cpp -o ../rwm -lncursesw -L. -ldesktop -lutil
+		g++ --std=c++17 $args $defines $sources -o ../rwm -lncursesw -L. -ldesktop -lutil -pthread
 	else 
-		g++ --std=c++17 $args rwm.cpp windows.cpp desktop.cpp charencoding.cpp -o ../rwm -lncursesw -lutil
+		g++ --std=c++17 $args $defines $sources desktop.cpp -o ../rwm -lncursesw -lutil -pthread
 	fi
-)
\ No newline at end of file
+) || exit 1
+
+# Checks in tests/; they are linked with RWM built without its main() (optimised like it for BENCH)
+if [ $check = 1 ] || [ $bench = 1 ]; then
+	checkargs="-O1"
+	if [ $bench = 1 ]; then
+		checkargs="$args"
+	fi
+	tmp=$(mktemp -d) || exit 1
+	trap 'rm -rf -- "$tmp"' EXIT
+	(
+		cd ./source || exit 1
+		for f in $sources desktop.cpp; do
+			g++ --std=c++17 $checkargs $defines -DRWM_NO_MAIN -c "$f" -o "$tmp/${f%.cpp}.o" || exit 1
+		done
+		g++ --std=c++17 $checkargs $defines ../tests/alloc_check.cpp "$tmp"/*.o -o "$tmp/alloc_check" -lncursesw -lutil -pthread || exit 1
+		g++ --std=c++17 $checkargs $defines ../tests/text_run_check.cpp "$tmp/vtparser.o" -o "$tmp/text_run_check" || exit 1
+
+		if [ $check = 1 ]; then
+			tic -x -o "$tmp/terminfo" ../etc/rwm.terminfo || exit 1
+			g++ --std=c++17 $checkargs $defines ../tests/terminfo_check.cpp "$tmp"/*.o -o "$tmp/terminfo_check" -lncursesw -lutil -pthread || exit 1
+			"$tmp/terminfo_check" ../etc/rwm.terminfo "$tmp/terminfo" || exit 1
+			"$tmp/alloc_check" || exit 1
+			"$tmp/text_run_check" || exit 1
+			g++ --std=c++17 $checkargs $defines ../tests/window_check.cpp "$tmp"/*.o -o "$tmp/window_check" -lncursesw -lutil -pthread || exit 1
+			"$tmp/window_check" || exit 1
+			g++ --std=c++17 $checkargs $defines ../tests/input_check.cpp "$tmp"/*.o -o "$tmp/input_check" -lncursesw -lutil -pthread || exit 1
+			"$tmp/input_check" || exit 1
+			g++ --std=c++17 $checkargs $defines ../tests/output_check.cpp "$tmp"/*.o -o "$tmp/output_check" -lncursesw -lutil -pthread || exit 1
+			"$tmp/output_check" "$tmp/terminfo" || exit 1
+		fi
+
+		# Benchmarks
+		if [ $bench = 1 ]; then
+			"$tmp/text_run_check" bench || exit 1
+			"$tmp/alloc_check" bench || exit 1
+			wraps="-Wl,--wrap=read,--wrap=write,--wrap=epoll_wait,--wrap=epoll_ctl,--wrap=poll,--wrap=ioctl,--wrap=syscall"
+			g++ --std=c++17 $checkargs $defines ../tests/read_bench.cpp "$tmp"/*.o -o "$tmp/read_bench" $wraps -lncursesw -lutil -pthread || exit 1
+			"$tmp/read_bench" || exit 1
+			wraps="-Wl,--wrap=wmove,--wrap=wadd_wchnstr,--wrap=wadd_wch,--wrap=waddch,--wrap=waddnstr,--wrap=setcchar,--wrap=wattr_set,--wrap=wattr_on,--wrap=wattr_off"
+			wraps="$wraps,--wrap=wcolor_set,--wrap=wtouchln,--wrap=wnoutrefresh,--wrap=wborder,--wrap=init_extended_pair,--wrap=init_extended_color"
+			g++ --std=c++17 $checkargs $defines ../tests/replay_bench.cpp "$tmp"/*.o -o "$tmp/replay_bench" $wraps -lncursesw -lutil -pthread || exit 1
+			"$tmp/replay_bench" || exit 1
+		fi
+	) || exit 1
+fi
@@ -15,6 +15,7 @@ fi
 cp rwm bin/rwmdebug bin/rwnopen /usr/bin
 mkdir -p "$HOME/.config/rwm"
 cp -r etc/* "$HOME/.config/rwm"
+tic -x -s etc/rwm.terminfo
 
 # Convoluted: we need to check if these files already exist, and if so, adjust where we install them
 
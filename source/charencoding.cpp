@@ -396,21 +396,20 @@ namespace rwm {
 		tty_get_avail_chars();
 	}
 
-	void waddstr_enc(WINDOW* win, std::string string, bool forceconv = force_convert) {
+	void waddstr_enc(WINDOW* win, std::string_view string, bool forceconv = force_convert) {
 		if ((!is_tty || !utf8) && !forceconv) 
-			waddstr(win, string.c_str());
+			waddnstr(win, string.data(), string.length());
 		else {
-			std::string out = "";
+			size_t out = 0;             // Start of the run of ASCII characters not drawn yet
 			std::string utfchar = "";
 			int n_cont_bytes = 0;
-			for (char c : string) {
+			for (size_t i = 0; i < string.length(); i++) {
+				char c = string[i];
 				if (utfchar.empty()) {
-					if (c >= 0) 
-						out += c;
-					else {
-						waddstr(win, out.c_str());
+					if (c < 0) {
+						if (i > out)
+							waddnstr(win, string.data() + out, i - out);
 						utfchar += c;
-						out = "";
 						n_cont_bytes = 
 							 ((c & 0xe0) ==  0xc0) ? 2 
 							:((c & 0xf0) ==  0xe0) ? 3
@@ -423,7 +422,7 @@ namespace rwm {
 						// c is not a valid continuation byte
 						waddstr(win, "?");
 						if (c >= 0) {
-							out = c;
+							out = i;
 							utfchar = "";
 						}
 						else
@@ -455,14 +454,16 @@ namespace rwm {
 						waddstr(win, unknown.c_str());
 						utfchar = "";
 					}
+					out = i + 1;
 				}
 			}
 			waddstr(win, utfchar.c_str());
-			waddstr(win, out.c_str());
+			if (utfchar.empty() && string.length() > out)
+				waddnstr(win, string.data() + out, string.length() - out);
 		}
 	}
 
-	size_t utf8length(std::string string) {
+	size_t utf8length(std::string_view string) {
 		if (!utf8 && !force_convert) 
 			return string.length();
 		size_t l = 0;
@@ -471,7 +472,7 @@ namespace rwm {
 		return l;
 	}
 
-	std::string utf8substr(std::string string, size_t start, size_t size) {
+	std::string_view utf8substr(std::string_view string, size_t start, size_t size) {
 		if (!utf8 && !force_convert) 
 			return string.substr(start, size);
 		size_t byte_start = 0, byte_size = 0, l = 0;
@@ -485,5 +486,63 @@ namespace rwm {
 		return string.substr(byte_start, byte_size + 1);
 	}
 
+	char32_t utf8_char(std::string_view string, size_t i, size_t& len, int& width) {
+		unsigned char c = string[i];
+		len = 1;
+		width = 1;
+		if (c < 0x80 || (!utf8 && !force_convert))
+			return c;
+		size_t char_len = ((c & 0xe0) == 0xc0) ? 2 : ((c & 0xf0) == 0xe0) ? 3 : ((c & 0xf8) == 0xf0) ? 4 : 1;
+		char32_t codepoint = (char_len == 2) ? (c & 0x1f) : (char_len == 3) ? (c & 0x0f) : (c & 0x07);
+		for (; len < char_len && i + len < string.length() && (string[i + len] & 0xc0) == 0x80; len++)
+			codepoint = (codepoint << 6) | (string[i + len] & 0x3f);
+		if (len < char_len || char_len == 1)
+			return '?';
+		width = wcwidth(codepoint);
+		if (width < 0) {
+			width = 1;  // Not printable
+			return '?';
+		}
+		return codepoint;
+	}
+
+	int utf8_char_width(std::string_view string, size_t i, size_t& len) {
+		int width;
+		utf8_char(string, i, len, width);
+		return width;
+	}
+
+	void utf8_append(std::string& string, char32_t codepoint) {
+		if (!utf8 && !force_convert) {
+			string += (char) codepoint;
+		} else if (codepoint < 0x80) {
+			string += (char) codepoint;
+		} else if (codepoint < 0x800) {
+			string += (char) (0xc0 | (codepoint >> 6));
+			string += (char) (0x80 | (codepoint & 0x3f));
+		} else if (codepoint < 0x10000) {
+			string += (char) (0xe0 | (codepoint >> 12));
+			string += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+			string += (char) (0x80 | (codepoint & 0x3f));
+		} else {
+			string += (char) (0xf0 | (codepoint >> 18));
+			string += (char) (0x80 | ((codepoint >> 12) & 0x3f));
+			string += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+			string += (char) (0x80 | (codepoint & 0x3f));
+		}
+	}
+
+	size_t utf8_complete_length(std::string_view string) {
+		size_t len = string.length();
+		for (size_t i = 1; i <= 4 && i <= len; i++) {
+			unsigned char c = string[len - i];
+			if ((c & 0xc0) == 0x80)
+				continue;
+			size_t char_len = (c < 0x80) ? 1 : ((c & 0xe0) == 0xc0) ? 2 : ((c & 0xf0) == 0xe0) ? 3 : 4;
+			return (i >= char_len) ? len : len - i;
+		}
+		return len;
+	}
+
 	//void put_acs_char()
 }
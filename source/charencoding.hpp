@@ -2,6 +2,7 @@
 #define RWM_CHARENC_H
 #include <vector>
 #include <string>
+#include <string_view>
 #include <ncurses.h>
 
 namespace rwm {
@@ -12,9 +13,13 @@ namespace rwm {
 	std::string codepoint_to_utf8(char32_t codepoint);
 	char32_t utf8_to_codepoint(std::string utf8char);
 	bool is_CJK(std::string utfchar);
-	void waddstr_enc(WINDOW* win, std::string string, bool forceconv = force_convert);
-	size_t utf8length(std::string string);
-	std::string utf8substr(std::string string, size_t start, size_t stop);
+	void waddstr_enc(WINDOW* win, std::string_view string, bool forceconv = force_convert);
+	size_t utf8length(std::string_view string);
+	std::string_view utf8substr(std::string_view string, size_t start, size_t stop);
+	size_t utf8_complete_length(std::string_view string);      // Length of `string` without a trailing incomplete UTF-8 character
+	int utf8_char_width(std::string_view string, size_t i, size_t& len); // Columns taken by the character at byte `i`; sets `len` to its length in bytes
+	char32_t utf8_char(std::string_view string, size_t i, size_t& len, int& width); // Character at byte `i` ('?' if it is invalid or not printable), like utf8_char_width
+	void utf8_append(std::string& string, char32_t codepoint);  // Appends a character as it was received (a single byte if not using UTF-8)
 	void init_encoding();
 }
 #endif
\ No newline at end of file
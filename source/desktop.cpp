@@ -9,10 +9,14 @@
 #include <unistd.h>
 #include <algorithm>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <signal.h>
 #include <iostream>
 #include "rwm.h"
+#include "events.hpp"
 #include "rwmdesktop.hpp"
 #include "charencoding.hpp"
+#include "output.hpp"
 #include "settings.cpp"
 
 namespace rwm_desktop {
@@ -28,6 +32,8 @@ namespace rwm_desktop {
 	std::string cwd = getenv("HOME");
 	char fifo_path[] = "/tmp/rwm/open.fifo";
 	int fifofd = -1;
+	int clockfd = -1;
+	bool showing_skipped = false;
 	rwm::Window* background;
 	std::vector<std::string> background_program = {};
 	std::vector<std::string> desktop_contents = {};
@@ -387,6 +393,7 @@ namespace rwm_desktop {
 		else 
 			i = {nullptr, {}};
 		rwm::windows.push_back(win);
+		rwm::invalidate_layout();
 		i.c = i.c ? i.c : &root_cell;
 		i.c->add(P_SEL_WIN, i);
 	}
@@ -429,6 +436,8 @@ namespace rwm_desktop {
 		std::string w_string = "";
 		for (Widget& w : widgets) 
 			w_string += w.get_str();
+		if (showing_skipped)
+			w_string = "[skipping frames]" + w_string;
 		attron(A_REVERSE);
 		mvaddstr(getmaxy(stdscr) - 1, getmaxx(stdscr) - rwm::utf8length(w_string) - 1, w_string.c_str());
 		attroff(A_REVERSE);
@@ -600,6 +609,14 @@ namespace rwm_desktop {
 		rwm_settings::read_settings(rwm_config + std::string("/settings.cfg"));
 		rwm_settings::read_settings(rwm_config + std::string("/theme.cfg"));
 
+		if (background) {
+			// Re-initialising; stop the old background program
+			rwm::unwatch(background->master);
+			kill(background->pid, SIGHUP);
+			close(background->master);
+			background = nullptr;
+		}
+
 		if (!background_program.empty()) {
 			rwm::ivec2 bgsize = {};
 			background = new rwm::Window(stdscr, "Background: " + background_program[0], rwm::FULLSCREEN | rwm::NO_EXIT, 0, 0);
@@ -609,6 +626,7 @@ namespace rwm_desktop {
 		}
 
 		open_fifo();
+		open_clock();
 		init_widgets();
 		draw_icons();
 		chdir(cwd.c_str());
@@ -621,6 +639,7 @@ namespace rwm_desktop {
 
 	void terminate() {
 		close_fifo();
+		close_clock();
 	}
 
 	void render() {
@@ -634,6 +653,12 @@ namespace rwm_desktop {
 		should_refresh = false;
 	} 
 
+	// Leaves the cursor alone: curs_set() would write to the terminal that frames are waiting on
+	void render_taskbar() {
+		draw_taskbar();
+		wnoutrefresh(stdscr);
+	}
+
 	void key_pressed(int key) {
 		switch(key) {
 			case '\x03':
@@ -684,6 +709,8 @@ namespace rwm_desktop {
 		echo();
 		move(getmaxy(stdscr) - 1, 7);
 		curs_set(1);
+		// getch has ncurses draw stdscr by itself, which direct output has to know about
+		rwm::resync_output();
 		while(true) {
 			int c = getch();
 			switch(c) {
@@ -691,6 +718,7 @@ namespace rwm_desktop {
 					int offset = rwm::windows.size();
 					open_program(input, {10 + 5 * offset, 10 + 10 * offset}, {32, 95});
 					curs_set(0);
+					rwm::resync_output();
 					return;
 				}
 
@@ -698,6 +726,7 @@ namespace rwm_desktop {
 				draw_taskbar();
 				noecho();
 				curs_set(0);
+				rwm::resync_output();
 				return;
 
 				case '\b': case KEY_BACKSPACE:
@@ -850,8 +879,8 @@ namespace rwm_desktop {
 			default:
 				break;
 			}
-			ungetch(key);
-			ungetch(27);
+			rwm::unget_key(key);
+			rwm::unget_key(27);
 			return true;
 		} else {
 			if (resize_mode & KEYBOARD && rwm::selected_window) {
@@ -929,6 +958,7 @@ namespace rwm_desktop {
 			rwm::Window* win = root_cell.get(pos);
 			if (pos == SEL_WIN && rwm::selected_window) {
 				win->status |= rwm::HIDDEN;
+				rwm::invalidate_layout();
 				rwm::selected_window = false;
 				curs_set(0);
 			} else {
@@ -986,22 +1016,26 @@ namespace rwm_desktop {
 	}
 
 	bool update() {
-		static bool have_updated = false;
 		read_fifo();
 		if (tiled_mode && SEL_WIN >= 0)
 			rwm::selected_window = true;
 
-		// Refresh every minute
-		auto now = std::chrono::system_clock::now().time_since_epoch();
-    	long long time = std::chrono::duration_cast<std::chrono::seconds>(now).count();
 		if (background) {
 			int ret = background->output();
 			if (ret == 1) 
 				should_refresh = true;
 		} 
-		if (time % 60 == 0 && !have_updated)
+
+		// Refresh every minute
+		uint64_t expirations;
+		if (clockfd != -1 && read(clockfd, &expirations, sizeof expirations) > 0)
+			should_refresh = true;
+
+		// Show whether frames are being skipped because the terminal is behind
+		if (rwm::dropping_frames() != showing_skipped) {
+			showing_skipped = !showing_skipped;
 			should_refresh = true;
-		have_updated = (time % 60) == 0;
+		}
 
 		return should_refresh;
 	}
@@ -1056,6 +1090,7 @@ namespace rwm_desktop {
 				case -8 ... -7:
 					// Minimize
 					win.status |= rwm::HIDDEN;
+					rwm::invalidate_layout();
 					if (i == SEL_WIN) {
 						rwm::selected_window = false;
 						curs_set(0);
@@ -1092,8 +1127,9 @@ namespace rwm_desktop {
 			do_frame(win, (resize_mode & (CHANGE_X | CHANGE_Y)) ? RESIZE : SELECTED);
 			wattroff(win.frame, A_REVERSE);
 
-			wrefresh(win.frame);
-			wrefresh(win.win);
+			wnoutrefresh(win.frame);
+			wnoutrefresh(win.win);
+			rwm::update_screen();
 			win.should_refresh = false;
 			return true;
 		} else if (bstate & BUTTON1_RELEASED) {
@@ -1141,8 +1177,10 @@ namespace rwm_desktop {
 	}
 
 	void close_fifo() {
-		if (fifofd != -1)
+		if (fifofd != -1) {
+			rwm::unwatch(fifofd);
 			close(fifofd);
+		}
 		fifofd = -1;
 		remove(fifo_path);
 	}
@@ -1157,11 +1195,39 @@ namespace rwm_desktop {
 			return;
 		}
 
-		fifofd = open(fifo_path, O_RDONLY | O_NONBLOCK);
+		// Opened for writing as well, so that the fifo does not hang up every time a writer closes it
+		fifofd = open(fifo_path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
 		if (fifofd == -1) {
 			show_info("Could not open rwm fifo!");
 			return;
 		}
+		rwm::watch(fifofd);
+	}
+
+	void close_clock() {
+		if (clockfd != -1) {
+			rwm::unwatch(clockfd);
+			close(clockfd);
+		}
+		clockfd = -1;
+	}
+
+	void open_clock() {
+		close_clock();
+		clockfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (clockfd == -1) {
+			show_info("Could not create rwm clock!");
+			return;
+		}
+
+		// Fire at the start of every minute
+		timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		itimerspec spec{};
+		spec.it_value.tv_sec = now.tv_sec - now.tv_sec % 60 + 60;
+		spec.it_interval.tv_sec = 60;
+		timerfd_settime(clockfd, TFD_TIMER_ABSTIME, &spec, nullptr);
+		rwm::watch(clockfd);
 	}
 
 	void read_fifo() {
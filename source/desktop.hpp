@@ -7,6 +7,7 @@ namespace rwm_desktop {
 	void init();                                      // Initialise desktop
 	void terminate();                                 // Callback on termination
 	void render();                                    // Render the desktop
+	void render_taskbar();                            // Render only the taskbar (while frames are skipped)
 	void key_pressed(int key);                        // Handle keypress (while focus on desktop)
 	bool key_priority(int key);                       // Handle any keypress (takes precedence over anything else; returns whether key was handled)
 	void mouse_pressed(MEVENT event);                 // Handle mouseclick
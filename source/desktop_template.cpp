@@ -17,9 +17,14 @@ namespace rwm_desktop {
 
 	void render() {
 		// Enter extra rendering code here
-		refresh();
+		// rwm shows the screen itself (see output.hpp), so only mark what to show
+		wnoutrefresh(stdscr);
 	} 
 
+	void render_taskbar() {
+		// Redraw whatever shows the state of RWM (such as skipped frames) on the last line here
+	}
+
 	void key_pressed(int key) {
 		// Input handling goes here
 		if (key == '\x03')
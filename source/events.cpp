@@ -0,0 +1,263 @@
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <unordered_map>
+#include "events.hpp"
+#include "windows.hpp"
+#include "uring.hpp"
+
+namespace rwm {
+	sigset_t default_signals;
+	sigset_t blocked_signals;
+	int epoll_fd = -1;
+	int signal_fd = -1;
+	int input_fd = 0;
+	int output_fd = 1;
+	int uring_event = 0;                                    // Sentinel for the io_uring instance, which is readable when reads have completed
+
+	// Reader thread
+	bool reader_thread = false;
+	std::thread reader;
+	std::mutex reader_mutex;                                // Held while the reader thread reads, and while a window is removed from it
+	std::unordered_map<int, Window*> reader_windows = {};   // Map [master] -> [window] of windows read by the reader thread
+	std::atomic<bool> reader_active{false};
+	int reader_epoll_fd = -1;
+	int reader_wake_fd = -1;                                // Written to by the main loop to stop the reader thread
+	int reader_notify_fd = -1;                              // Written to by the reader thread when windows have new output
+
+	void init_events() {
+		if (epoll_fd != -1)
+			return;
+
+		// SIGCHLD and SIGWINCH are delivered through signal_fd instead of asynchronous handlers
+		sigemptyset(&blocked_signals);
+		sigaddset(&blocked_signals, SIGCHLD);
+		sigaddset(&blocked_signals, SIGWINCH);
+		sigprocmask(SIG_BLOCK, &blocked_signals, &default_signals);
+
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		signal_fd = signalfd(-1, &blocked_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+		if (epoll_fd == -1 || signal_fd == -1) {
+			std::cerr << "Could not initialise event loop!\n";
+			exit(EXIT_FAILURE);
+		}
+
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.ptr = &input_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, input_fd, &ev);
+		ev.data.ptr = &signal_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+	}
+
+	void rearm(int fd) {
+		epoll_event ev{};
+		ev.events = EPOLLIN | EPOLLONESHOT;
+		ev.data.fd = fd;
+		epoll_ctl(reader_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	void read_windows() {
+		epoll_event events[64];
+		uint64_t one = 1;
+		while (reader_active) {
+			int n = epoll_wait(reader_epoll_fd, events, 64, -1);
+			bool notify = false;
+			std::lock_guard<std::mutex> lock(reader_mutex);
+			for (int i = 0; i < n; i++) {
+				// Windows may have been removed since epoll_wait returned
+				auto it = reader_windows.find(events[i].data.fd);
+				if (it == reader_windows.end())
+					continue;
+				Window* win = it->second;
+
+				// Masters are watched with EPOLLONESHOT; a full window is only watched again once the main loop has caught up
+				switch (win->fill_buffer()) {
+					case READ_FULL:
+					win->reader_paused = true;
+					break;
+
+					case READ_HUP:
+					win->hung_up = true;
+					break;
+
+					default:
+					rearm(it->first);
+					break;
+				}
+				notify = true;
+			}
+			// The eventfd cannot overflow from this; a failed write only means the main loop is already woken
+			if (notify)
+				(void) !write(reader_notify_fd, &one, sizeof one);
+		}
+	}
+
+	bool start_reader() {
+		if (reader_active)
+			return true;
+		reader_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		reader_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		reader_notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (reader_epoll_fd == -1 || reader_wake_fd == -1 || reader_notify_fd == -1) {
+			close(reader_epoll_fd);
+			close(reader_wake_fd);
+			close(reader_notify_fd);
+			reader_epoll_fd = reader_wake_fd = reader_notify_fd = -1;
+			return false;
+		}
+
+		epoll_event ev{};
+		ev.events = EPOLLIN;
+		ev.data.fd = reader_wake_fd;
+		epoll_ctl(reader_epoll_fd, EPOLL_CTL_ADD, reader_wake_fd, &ev);
+		ev.data.ptr = &reader_notify_fd;
+		epoll_ctl(epoll_fd, EPOLL_CTL_ADD, reader_notify_fd, &ev);
+
+		reader_active = true;
+		reader = std::thread(read_windows);
+		return true;
+	}
+
+	void stop_reader() {
+		if (!reader_active)
+			return;
+		uint64_t one = 1;
+		reader_active = false;
+		(void) !write(reader_wake_fd, &one, sizeof one);
+		reader.join();
+		reader_windows.clear();
+		close(reader_epoll_fd);
+		close(reader_wake_fd);
+		close(reader_notify_fd);
+		reader_epoll_fd = reader_wake_fd = reader_notify_fd = -1;
+	}
+
+	void resume_reading(int fd) {
+		if (reader_epoll_fd != -1)
+			rearm(fd);
+	}
+
+	void close_events() {
+		stop_reader();
+		close_uring();
+		close(signal_fd);
+		close(epoll_fd);
+		signal_fd = epoll_fd = -1;
+		sigprocmask(SIG_SETMASK, &default_signals, nullptr);
+	}
+
+	void watch(int fd, Window* win) {
+		if (fd < 0)
+			return;
+		epoll_event ev{};
+		if (win && use_io_uring && uring_watch(fd, win)) {
+			win->reader = URING_READER;
+			ev.events = EPOLLIN;
+			ev.data.ptr = &uring_event;
+			epoll_ctl(epoll_fd, EPOLL_CTL_ADD, uring_fd(), &ev);
+			return;
+		} else if (win && reader_thread && start_reader()) {
+			win->reader = THREAD_READER;
+			{
+				std::lock_guard<std::mutex> lock(reader_mutex);
+				reader_windows.insert_or_assign(fd, win);
+			}
+			ev.events = EPOLLIN | EPOLLONESHOT;
+			ev.data.fd = fd;
+			if (epoll_ctl(reader_epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1 && errno == EEXIST)
+				epoll_ctl(reader_epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+			return;
+		}
+		if (win)
+			win->reader = EPOLL_READER;
+		ev.events = EPOLLIN;
+		ev.data.ptr = win;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1 && errno == EEXIST)
+			epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	void unwatch(int fd) {
+		if (fd < 0)
+			return;
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+		if (uring_unwatch(fd))
+			return;
+		if (reader_epoll_fd != -1) {
+			epoll_ctl(reader_epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+			// Once the lock is held, the reader thread is done with the window
+			std::lock_guard<std::mutex> lock(reader_mutex);
+			reader_windows.erase(fd);
+		}
+	}
+
+	void watch_output(int fd, Window* win, bool on) {
+		epoll_event ev{};
+		ev.data.ptr = win;
+		if (win->reader == EPOLL_READER) {
+			ev.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN;
+			epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+		} else {
+			// Masters read elsewhere are only in the main epoll instance while their input is backed up
+			ev.events = EPOLLOUT;
+			epoll_ctl(epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev);
+		}
+	}
+
+	void watch_terminal(bool on) {
+		epoll_event ev{};
+		ev.events = EPOLLOUT;
+		ev.data.ptr = &output_fd;
+		epoll_ctl(epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, output_fd, &ev);
+	}
+
+	int read_signals() {
+		int ret = 0;
+		signalfd_siginfo info;
+		while (read(signal_fd, &info, sizeof info) == sizeof info) {
+			if (info.ssi_signo == SIGCHLD)
+				ret |= CHILD_EVENT;
+			else if (info.ssi_signo == SIGWINCH)
+				ret |= RESIZE_EVENT;
+		}
+		return ret;
+	}
+
+	int wait_events(int timeout) {
+		epoll_event events[64];
+		int n = epoll_wait(epoll_fd, events, 64, timeout);
+		int ret = 0;
+		for (int i = 0; i < n; i++) {
+			void* source = events[i].data.ptr;
+			if (source == &input_fd) {
+				ret |= INPUT_EVENT;
+			} else if (source == &output_fd) {
+				ret |= TERMINAL_EVENT;
+			} else if (source == &signal_fd) {
+				ret |= read_signals();
+			} else if (source == &uring_event) {
+				uring_reap();
+				ret |= WINDOW_EVENT;
+			} else if (source == &reader_notify_fd) {
+				uint64_t count;
+				(void) !read(reader_notify_fd, &count, sizeof count);
+				ret |= WINDOW_EVENT;
+			} else if (source) {
+				// Windows are only flagged here; they may be closed while handling other events
+				// (the input of all windows is flushed on every iteration, so being writable needs no flag)
+				if (events[i].events & ~EPOLLOUT)
+					((Window*) source)->readable = true;
+				ret |= WINDOW_EVENT;
+			} else {
+				ret |= OTHER_EVENT;
+			}
+		}
+		return ret;
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef RWM_EVENTS_H
+#define RWM_EVENTS_H
+#include <signal.h>
+
+namespace rwm {
+	struct Window;
+
+	enum EVENTS {
+		INPUT_EVENT = 1,        // Terminal input is available on stdin
+		CHILD_EVENT = 2,        // A child process has changed state (SIGCHLD)
+		RESIZE_EVENT = 4,       // The terminal has been resized (SIGWINCH)
+		WINDOW_EVENT = 8,       // At least one window has data to read
+		OTHER_EVENT = 16,       // Any other watched file descriptor is ready
+		TERMINAL_EVENT = 32,    // The terminal can take more output
+	};
+
+	extern sigset_t default_signals;                 // Signal mask RWM was started with; restore it in child processes
+	extern bool reader_thread;                       // Read the output of new windows on a separate thread
+
+	void init_events();                              // Blocks SIGCHLD/SIGWINCH and creates the epoll instance and signalfd
+	void close_events();                             // Closes epoll instance and signalfd
+	void watch(int fd, Window* win = nullptr);       // Wakes the main loop when `fd` becomes readable; if `win` is set, marks it as readable (or has it read through io_uring or by the reader thread)
+	void unwatch(int fd);                            // Stops watching `fd`
+	void watch_output(int fd, Window* win, bool on); // (Stops) waking the main loop when the master `fd` of `win` becomes writable
+	void watch_terminal(bool on);                    // (Stops) waking the main loop when the terminal can take more output
+	void resume_reading(int fd);                     // Lets the reader thread read from `fd` again after it paused on a full buffer
+	int wait_events(int timeout);                    // Waits at most `timeout` ms (-1 = forever) for events; returns a mask of EVENTS
+}
+#endif
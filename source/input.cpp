@@ -0,0 +1,229 @@
+#include <ncurses.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "input.hpp"
+
+namespace rwm {
+	std::unordered_map<std::string, int> key_sequences = {};    // Map [escape sequence] -> [key code]
+	bool key_starts[256] = {};                                  // Does any key sequence start with this byte?
+	size_t max_key_length = 0;                                  // Length of the longest key sequence
+	std::unordered_set<std::string> key_prefixes = {};          // Beginnings of key sequences, which may be cut short by a read
+	std::string input_carry = "";                               // Incomplete mouse report, paste marker or key sequence left over from the last read
+	bool key_carried = false;                                   // Is input_carry the beginning of a key sequence?
+	timespec key_carried_at = {};                               // When it was left over
+	const long key_timeout = 25;                                // Time (ms) after which a key sequence cut short is taken as separate keys
+	int last_button = 0;                                        // Last pressed mouse button (X10 reports do not tell which button was released)
+	bool in_paste = false;                                      // Between the terminal's bracketed paste markers
+	const std::string paste_start = "\033[200~";
+	const std::string paste_end = "\033[201~";
+
+	void add_key_sequence(std::string seq, int key) {
+		if (seq.empty() || key_sequences.find(seq) != key_sequences.end())
+			return;
+		key_sequences.insert_or_assign(seq, key);
+		key_starts[(unsigned char) seq[0]] = true;
+		max_key_length = std::max(max_key_length, seq.length());
+		for (size_t len = 1; len < seq.length(); len++)
+			key_prefixes.insert(seq.substr(0, len));
+	}
+
+	void init_input() {
+		key_sequences.clear();
+		key_prefixes.clear();
+		for (int key = KEY_MIN; key < 1024; key++) {
+			// Mouse reports carry data after the prefix; they are decoded separately
+			if (key == KEY_MOUSE)
+				continue;
+			for (int n = 0; char* seq = keybound(key, n); n++) {
+				add_key_sequence(seq, key);
+				free(seq);
+			}
+		}
+
+		// Cursor keys are sent as CSI or SS3 depending on whether the terminal is in keypad transmit mode
+		std::vector<std::pair<std::string, int>> cursor_keys;
+		for (auto& it : key_sequences) {
+			const std::string& seq = it.first;
+			if (seq.length() == 3 && seq[0] == '\033' && (seq[1] == 'O' || seq[1] == '[') && strchr("ABCDHF", seq[2]))
+				cursor_keys.push_back({std::string("\033") + ((seq[1] == 'O') ? '[' : 'O') + seq[2], it.second});
+		}
+		for (auto& it : cursor_keys)
+			add_key_sequence(it.first, it.second);
+	}
+
+	void set_mouse(int b, int x, int y, bool pressed, input_event& ev) {
+		int button;
+		if (b & 32) {
+			// Motion; only reported if the terminal tracks it regardless of what was requested
+			ev.key = ERR;
+			return;
+		} else if (b & 64) {
+			button = 4 + (b & 1);
+		} else if ((b & 3) == 3) {
+			button = last_button;
+			pressed = false;
+		} else {
+			button = (b & 3) + 1;
+		}
+
+		if (button == 0) {
+			ev.key = ERR;
+			return;
+		}
+		if (pressed && !(b & 64))
+			last_button = button;
+
+		ev.key = KEY_MOUSE;
+		ev.mouse.id = 0;
+		ev.mouse.x = x;
+		ev.mouse.y = y;
+		ev.mouse.z = 0;
+		ev.mouse.bstate = NCURSES_MOUSE_MASK(button, pressed ? NCURSES_BUTTON_PRESSED : NCURSES_BUTTON_RELEASED);
+		ev.mouse.bstate |= ((b & 4) ? BUTTON_SHIFT : 0) | ((b & 8) ? BUTTON_ALT : 0) | ((b & 16) ? BUTTON_CTRL : 0);
+	}
+
+	// Returns the length of the mouse report at `i`, 0 if there is none, -1 if it is incomplete
+	int decode_mouse(const std::string& in, size_t i, input_event& ev) {
+		if (!in.compare(i, 3, "\033[M")) {
+			// X10/normal tracking: ESC [ M Cb Cx Cy
+			if (in.length() < i + 6)
+				return -1;
+			set_mouse((unsigned char) in[i + 3] - 32, (unsigned char) in[i + 4] - 33, (unsigned char) in[i + 5] - 33, true, ev);
+			return 6;
+		} else if (!in.compare(i, 3, "\033[<")) {
+			// SGR tracking: ESC [ < Cb ; Cx ; Cy M/m
+			int params[3] = {0, 0, 0};
+			int n = 0;
+			for (size_t j = i + 3; j < in.length(); j++) {
+				char c = in[j];
+				if ('0' <= c && c <= '9') {
+					params[n] = std::min(params[n] * 10 + c - '0', 100000);
+				} else if (c == ';' && n < 2) {
+					n++;
+				} else if ((c == 'M' || c == 'm') && n == 2) {
+					set_mouse(params[0], params[1] - 1, params[2] - 1, c == 'M', ev);
+					return j - i + 1;
+				} else {
+					ev.key = ERR;
+					return j - i + 1;
+				}
+			}
+			return -1;
+		}
+		return 0;
+	}
+
+	// Returns the length of the key at `i`; -1 if the rest of the input is the beginning of a key sequence and `wait` is set
+	int decode_key(const std::string& in, size_t i, input_event& ev, bool wait) {
+		unsigned char c = in[i];
+		if (key_starts[c]) {
+			if (wait && in.length() - i < max_key_length && key_prefixes.count(in.substr(i)))
+				return -1;
+			for (size_t len = std::min(max_key_length, in.length() - i); len > 0; len--) {
+				auto it = key_sequences.find(in.substr(i, len));
+				if (it != key_sequences.end()) {
+					ev.key = it->second;
+					return len;
+				}
+			}
+		}
+		ev.key = c;
+		return 1;
+	}
+
+	int input_timeout() {
+		if (!key_carried)
+			return -1;
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long waited = (now.tv_sec - key_carried_at.tv_sec) * 1000 + (now.tv_nsec - key_carried_at.tv_nsec) / 1000000;
+		return std::max(key_timeout - waited, 0L);
+	}
+
+	void read_input(std::vector<input_event>& events) {
+		char buf[4096];
+		std::string in = input_carry;
+		// A key sequence cut short that nothing followed within key_timeout was typed as it is (e.g. a lone ESC)
+		bool was_key = key_carried;
+		bool expired = (input_timeout() == 0);
+		size_t carried = in.length();
+		input_carry = "";
+		key_carried = false;
+		events.clear();
+
+		// stdin shares its file description with stdout, so it cannot be made non-blocking; read exactly what is there
+		int avail = 0;
+		while (ioctl(0, FIONREAD, &avail) == 0 && avail > 0) {
+			int ret = read(0, buf, std::min(avail, (int) sizeof buf));
+			if (ret <= 0)
+				break;
+			in.append(buf, ret);
+		}
+		bool wait = !(expired && in.length() == carried);
+
+		for (size_t i = 0; i < in.length();) {
+			input_event ev{};
+			if (in_paste) {
+				// Pasted text is passed on in bulk instead of being decoded key by key
+				size_t end = in.find(paste_end, i);
+				size_t carry = 0;
+				if (end == std::string::npos) {
+					end = in.length();
+					// Keep a partial end marker for the next read
+					for (carry = std::min(paste_end.length() - 1, end - i); carry > 0; carry--)
+						if (!in.compare(end - carry, carry, paste_end, 0, carry))
+							break;
+					end -= carry;
+				} else {
+					in_paste = false;
+					ev.paste = PASTE_END;
+				}
+				ev.key = KEY_PASTE;
+				ev.text = in.substr(i, end - i);
+				if (!ev.text.empty() || ev.paste)
+					events.push_back(ev);
+				if (carry)
+					input_carry = in.substr(end);
+				i = in_paste ? in.length() : end + paste_end.length();
+				continue;
+			} else if (!in.compare(i, paste_start.length(), paste_start)) {
+				in_paste = true;
+				ev.key = KEY_PASTE;
+				ev.paste = PASTE_START;
+				events.push_back(ev);
+				i += paste_start.length();
+				continue;
+			} else if (in.length() - i >= 3 && in.length() - i < paste_start.length() && !in.compare(i, std::string::npos, paste_start, 0, in.length() - i)) {
+				input_carry = in.substr(i);
+				break;
+			}
+
+			int len = (in[i] == '\033') ? decode_mouse(in, i, ev) : 0;
+			if (len < 0) {
+				input_carry = in.substr(i);
+				break;
+			} else if (len == 0) {
+				len = decode_key(in, i, ev, wait);
+				if (len < 0) {
+					// The rest of the sequence is likely in the next read; the wait starts when the beginning arrived
+					input_carry = in.substr(i);
+					key_carried = true;
+					if (!was_key || in.length() > carried)
+						clock_gettime(CLOCK_MONOTONIC, &key_carried_at);
+					break;
+				}
+			}
+			if (ev.key != ERR)
+				events.push_back(ev);
+			i += len;
+		}
+	}
+}
@@ -0,0 +1,26 @@
+#ifndef RWM_INPUT_H
+#define RWM_INPUT_H
+#include <ncurses.h>
+#include <vector>
+#include <string>
+
+namespace rwm {
+	const int KEY_PASTE = KEY_MAX + 1;                       // Pseudo key code for text pasted into the terminal
+
+	enum PASTE_FLAGS {
+		PASTE_START = 1,        // First part of a paste
+		PASTE_END = 2,          // Last part of a paste
+	};
+
+	struct input_event {
+		int key;                // Key code as ncurses' getch would return it; KEY_MOUSE for mouse events, KEY_PASTE for pasted text
+		MEVENT mouse;           // Mouse event (only if key == KEY_MOUSE)
+		std::string text;       // Pasted text (only if key == KEY_PASTE)
+		int paste;              // PASTE_FLAGS (only if key == KEY_PASTE)
+	};
+
+	void init_input();                                       // Builds the key sequence table from terminfo
+	void read_input(std::vector<input_event>& events);       // Reads all pending terminal input and decodes it into `events`; a paste in bracketed paste mode becomes KEY_PASTE events
+	int input_timeout();                                     // Time (ms) until read_input should be called even without input, for a key sequence cut short; -1 = none
+}
+#endif
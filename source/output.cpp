@@ -0,0 +1,666 @@
+#include <ncurses.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <string.h>
+#include <wchar.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <string_view>
+#include "output.hpp"
+#include "events.hpp"
+#include "windows.hpp"
+#include "charencoding.hpp"
+
+namespace rwm {
+	bool direct_output = false;
+	int max_queued_output = 4096;
+
+	// Character cell as shown by the terminal; compared with memcmp, so it has no padding
+	struct term_cell {
+		wchar_t ch = 0;                    // Codepoint; 0 = right half of the wide character left of it
+		wchar_t comb = 0;                  // Combining character drawn over it, 0 if there is none
+		uint32_t attr = 0;                 // ncurses attributes without the color pair
+		int pair = -1;                     // Color pair; -1 = not known (the cell is sent whatever it becomes)
+	};
+
+	std::vector<term_cell> front = {};    // What the terminal shows, row by row
+	std::vector<term_cell> back = {};     // Frame being shown
+	std::vector<size_t> front_hash = {};  // Hash of each row of `front`
+	std::vector<size_t> back_hash = {};   // Hash of each row of `back`
+	term_cell* row = nullptr;             // Row of `back` being compared with `front`
+	std::vector<cchar_t> line = {};
+	int front_lines = 0, front_cols = 0;  // Size of `front`; the terminal was resized if it differs
+	int cur_y = -1, cur_x = -1;           // Cursor of the terminal; -1 = not known
+	uint32_t pen_attr = 0;                // Attributes the terminal draws with
+	int pen_pair = 0;                     // Color pair the terminal draws with; -1 = not known
+	std::vector<short> pair_colors = {};  // Foreground and background of each color pair looked up so far; -2 = not looked up
+	// Hash and row of each row of `front`, sorted by hash; the row is -1 where several show the same (for find_scroll)
+	std::vector<std::pair<size_t, int>> shown_rows = {};
+	std::vector<int> votes = {};          // Changed rows found at each distance, from -front_lines up (for find_scroll)
+	std::string out = "";                 // Frame being composed
+	std::string unsent = "";              // Part of the last frame the terminal has not taken yet
+	timespec frame_start = {};            // When the last frame started being written
+	timespec frame_end = {};              // When the terminal had taken all of it
+	timespec last_skip = {};              // When a frame was last skipped
+	long write_latency = 0;               // Time (us) the terminal took to take the last frame
+	long frames_skipped = 0;              // Frames skipped because the terminal was behind
+
+	// VT100 line drawing characters ('`' to '~') as drawn with A_ALTCHARSET
+	const wchar_t acs_chars[] = L"◆▒␉␌␍␊°±␤␋┘┐┌└┼⎺⎻─⎼⎽├┤┴┬│≤≥π≠£·";
+
+	// Sequences of the terminal, from terminfo; nullptr where it has none (the ways of getting there that need them are
+	// not considered)
+	struct term_caps {
+		const char* cup = get("cup");
+		const char* home = get("home");
+		const char* cr = get("cr");
+		const char* cuf = get("cuf");
+		const char* cub = get("cub");
+		const char* cuf1 = get("cuf1");
+		const char* cub1 = get("cub1");
+		const char* cuu = get("cuu");
+		const char* cud = get("cud");
+		const char* cuu1 = get("cuu1");
+		const char* hpa = get("hpa");
+		const char* vpa = get("vpa");
+		const char* ech = get("ech");
+		const char* csr = get("csr");
+		const char* ind = get("ind");
+		const char* ri = get("ri");
+		const char* indn = get("indn");
+		const char* rin = get("rin");
+		const char* setaf = get("setaf");
+		const char* setab = get("setab");
+		const char* sgr0 = get("sgr0");
+		bool bce = tigetflag((char*) "bce") > 0;
+		bool xenl = tigetflag((char*) "xenl") > 0;
+		// Attributes the terminal has a sequence for
+		uint32_t attrs = (get("bold") ? A_BOLD : 0) | (get("dim") ? A_DIM : 0) | (get("sitm") ? A_ITALIC : 0)
+		    | (get("smul") ? A_UNDERLINE : 0) | (get("blink") ? A_BLINK : 0) | (get("rev") ? A_REVERSE : 0) | (get("invis") ? A_INVIS : 0);
+
+		static const char* get(const char* name) {
+			const char* s = tigetstr((char*) name);
+			return (s && s != (const char*) -1) ? s : nullptr;
+		}
+	};
+
+	const term_caps& caps() {
+		static const term_caps caps;
+		return caps;
+	}
+
+	// Plain SGR and UTF-8 are written, and every way of moving the cursor falls back on cup
+	bool writes_directly() {
+		return direct_output && utf8 && caps().cup;
+	}
+
+	void add_cap(std::string& s, const char* cap, int p1 = 0, int p2 = 0) {
+		s += tiparm(cap, p1, p2);
+	}
+
+	bool same(const term_cell* a, const term_cell* b, int n = 1) {
+		return memcmp(a, b, n * sizeof(term_cell)) == 0;
+	}
+
+	long since(const timespec& t) {
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (now.tv_sec - t.tv_sec) * 1000000L + (now.tv_nsec - t.tv_nsec) / 1000;
+	}
+
+	// Writes `unsent` until the terminal takes no more without blocking (or all of it if `block`);
+	// returns whether all of it was written
+	bool write_unsent(bool block) {
+		if (unsent.empty())
+			return true;
+		// Only set around these writes: ncurses keeps retrying on a non-blocking terminal
+		int flags = fcntl(STDOUT_FILENO, F_GETFL);
+		if (!block && flags >= 0)
+			fcntl(STDOUT_FILENO, F_SETFL, flags | O_NONBLOCK);
+		size_t done = 0;
+		while (done < unsent.size()) {
+			ssize_t n = write(STDOUT_FILENO, unsent.data() + done, unsent.size() - done);
+			if (n > 0) {
+				done += n;
+			} else if (n == 0) {
+				// Nothing taken and no error; errno is stale, so this is left for the next flush
+				break;
+			} else if (errno == EAGAIN && !block) {
+				break;
+			} else if (errno != EINTR && errno != EAGAIN) {
+				// The terminal is gone; nothing is kept for it
+				done = unsent.size();
+			}
+		}
+		if (!block && flags >= 0)
+			fcntl(STDOUT_FILENO, F_SETFL, flags);
+		unsent.erase(0, done);
+		if (unsent.empty() && !block) {
+			clock_gettime(CLOCK_MONOTONIC, &frame_end);
+			write_latency = since(frame_start);
+		}
+		// The rest is written as the terminal takes it (see flush_output)
+		static bool watching = false;
+		if (watching != !unsent.empty()) {
+			watching = !unsent.empty();
+			watch_terminal(watching);
+		}
+		return unsent.empty();
+	}
+
+	void write_out(const std::string& s) {
+		unsent += s;
+		write_unsent(true);
+	}
+
+	// Reads row y of `win` (newscr or curscr) into `row`, one cell per column
+	void read_row(WINDOW* win, int y, term_cell* row) {
+		mvwin_wchnstr(win, y, 0, line.data(), front_cols);
+		// Wide characters come as one cell; their right halves are left out
+		int x = 0;
+		for (int i = 0; x < front_cols && i < front_cols; i++) {
+			wchar_t wch[CCHARW_MAX + 1] = {};
+			attr_t attr;
+			short pair_s = 0;
+			int pair = 0;
+			getcchar(&line[i], wch, &attr, &pair_s, HAS_EXT_COLOR ? &pair : nullptr);
+			if (!HAS_EXT_COLOR)
+				pair = pair_s;
+			term_cell c{wch[0], wch[1], (uint32_t) (attr & A_ATTRIBUTES & ~A_COLOR), pair};
+			if (c.attr & A_STANDOUT)
+				c.attr = (c.attr & ~A_STANDOUT) | A_REVERSE;
+			if ((c.attr & A_ALTCHARSET) && c.ch >= '`' && c.ch <= '~') {
+				c.ch = acs_chars[c.ch - '`'];
+				c.attr &= ~A_ALTCHARSET;
+			}
+			row[x++] = c;
+			if (wcwidth(c.ch) > 1 && x < front_cols) {
+				c.ch = c.comb = 0;
+				row[x++] = c;
+			}
+		}
+		for (; x < front_cols; x++)
+			row[x] = term_cell{' ', 0, 0, 0};
+	}
+
+	void add_number(std::string& s, int n) {
+		s += std::to_string(n);
+	}
+
+	// Shortest way of moving the cursor from where it is to (y, x)
+	void move_to(int y, int x) {
+		if (cur_y == y && cur_x == x)
+			return;
+		const term_caps& cap = caps();
+		std::string best = (y == 0 && x == 0 && cap.home) ? cap.home : tiparm(cap.cup, y, x);
+
+		std::string s;
+		auto consider = [&]() {
+			if (s.size() < best.size())
+				best = s;
+		};
+		if (cur_y == y && cur_x >= 0) {
+			int n = std::abs(x - cur_x);
+			const char* one = (x > cur_x) ? cap.cuf1 : cap.cub1;
+			const char* many = (x > cur_x) ? cap.cuf : cap.cub;
+			if (n == 1 && one) {
+				s = one;
+				consider();
+			}
+			if (many) {
+				s.clear();
+				add_cap(s, many, n);
+				consider();
+			}
+			if (cap.cr && (x == 0 || (x == 1 && cap.cuf1) || cap.cuf)) {
+				s = cap.cr;
+				if (x == 1 && cap.cuf1)
+					s += cap.cuf1;
+				else if (x > 0)
+					add_cap(s, cap.cuf, x);
+				consider();
+			}
+			if (cap.hpa) {
+				s.clear();
+				add_cap(s, cap.hpa, x);
+				consider();
+			}
+		} else if (cur_x == x && cur_y >= 0) {
+			int n = std::abs(y - cur_y);
+			// cud1 is not used, as it is often a line feed, which the terminal may turn into a new line
+			if (n == 1 && y < cur_y && cap.cuu1) {
+				s = cap.cuu1;
+				consider();
+			}
+			if ((y > cur_y) ? cap.cud : cap.cuu) {
+				s.clear();
+				add_cap(s, (y > cur_y) ? cap.cud : cap.cuu, n);
+				consider();
+			}
+			if (cap.vpa) {
+				s.clear();
+				add_cap(s, cap.vpa, y);
+				consider();
+			}
+		}
+		out += best;
+		cur_y = y;
+		cur_x = x;
+	}
+
+	void add_color(std::string& s, int color, bool bg) {
+		if (!s.empty())
+			s += ';';
+		if (color < 0)
+			add_number(s, bg ? 49 : 39);
+		else if (color < 8)
+			add_number(s, (bg ? 40 : 30) + color);
+		else if (color < 16)
+			add_number(s, (bg ? 100 : 90) + color - 8);
+		else {
+			s += bg ? "48;5;" : "38;5;";
+			add_number(s, color);
+		}
+	}
+
+	// Pair 0 has the terminal's default colors
+	void get_colors(int pair, int& fg, int& bg) {
+		if (pair == 0) {
+			fg = bg = -1;
+			return;
+		}
+		if ((size_t) pair >= pair_colors.size() / 2)
+			pair_colors.resize((pair + 1) * 2, -2);
+		if (pair_colors[pair * 2] == -2) {
+			if (HAS_EXT_COLOR) {
+				extended_pair_content(pair, &fg, &bg);
+			} else {
+				short f, b;
+				pair_content(pair, &f, &b);
+				fg = f;
+				bg = b;
+			}
+			pair_colors[pair * 2] = fg;
+			pair_colors[pair * 2 + 1] = bg;
+		}
+		fg = pair_colors[pair * 2];
+		bg = pair_colors[pair * 2 + 1];
+	}
+
+	// Only the attributes and colors that change are sent (unless starting over from SGR 0 is shorter)
+	// Attributes and colors the terminal has no sequence for are left out
+	void set_pen(uint32_t attr, int pair) {
+		const term_caps& cap = caps();
+		attr &= cap.attrs;
+		if (attr == pen_attr && pair == pen_pair)
+			return;
+		static const std::pair<uint32_t, int> codes[] = {
+			{A_BOLD, 1}, {A_DIM, 2}, {A_ITALIC, 3}, {A_UNDERLINE, 4}, {A_BLINK, 5}, {A_REVERSE, 7}, {A_INVIS, 8}
+		};
+		int fg, bg, old_fg = -1, old_bg = -1;
+		get_colors(pair, fg, bg);
+		if (pen_pair >= 0)
+			get_colors(pen_pair, old_fg, old_bg);
+		if (!cap.setaf)
+			fg = old_fg = -1;
+		if (!cap.setab)
+			bg = old_bg = -1;
+
+		// From scratch
+		std::string reset = "0";
+		for (auto [a, code] : codes)
+			if (attr & a)
+				reset += ';' + std::to_string(code);
+		if (fg >= 0)
+			add_color(reset, fg, false);
+		if (bg >= 0)
+			add_color(reset, bg, true);
+
+		// As a change
+		std::string delta;
+		if (pen_pair >= 0) {
+			uint32_t off = pen_attr & ~attr;
+			uint32_t on = attr & ~pen_attr;
+			// Bold and dim are turned off together
+			if (off & (A_BOLD | A_DIM)) {
+				delta = "22";
+				on |= attr & (A_BOLD | A_DIM);
+			}
+			for (auto [a, code] : codes) {
+				if ((off & a) && !(a & (A_BOLD | A_DIM))) {
+					if (!delta.empty())
+						delta += ';';
+					add_number(delta, code + 20);
+				}
+			}
+			for (auto [a, code] : codes) {
+				if (on & a) {
+					if (!delta.empty())
+						delta += ';';
+					add_number(delta, code);
+				}
+			}
+			if (fg != old_fg)
+				add_color(delta, fg, false);
+			if (bg != old_bg)
+				add_color(delta, bg, true);
+		}
+		out += "\033[";
+		out += (pen_pair < 0 || reset.size() <= delta.size()) ? (reset == "0" ? "" : reset) : delta;
+		out += 'm';
+		pen_attr = attr;
+		pen_pair = pair;
+	}
+
+	// Whether the terminal can erase to cell c (ECH erases to blanks of the current background color)
+	bool can_erase(const term_cell& c) {
+		const term_caps& cap = caps();
+		if (!cap.ech || c.ch != ' ' || c.comb || c.attr)
+			return false;
+		int fg, bg;
+		get_colors(c.pair, fg, bg);
+		return cap.bce || bg < 0;
+	}
+
+	void put(int y, int x) {
+		term_cell& c = row[x];
+		move_to(y, x);
+		set_pen(c.attr, c.pair);
+		utf8_append(out, c.ch);
+		if (c.comb)
+			utf8_append(out, c.comb);
+		bool wide = x + 1 < front_cols && row[x + 1].ch == 0;
+		std::copy_n(&row[x], wide ? 2 : 1, &front[(size_t) y * front_cols + x]);
+		cur_x += wide ? 2 : 1;
+		// At the right margin, the terminal waits for the next character to wrap
+		if (cur_x >= front_cols)
+			cur_x = -1;
+	}
+
+	size_t hash_row(const term_cell* r) {
+		return std::hash<std::string_view>{}(std::string_view((const char*) r, front_cols * sizeof(term_cell)));
+	}
+
+	// Scrolls rows top to bot of the terminal (and of `front`) up by n rows (down if negative)
+	void scroll_front(int top, int bot, int n) {
+		// The rows that are freed are blanked in the default colors
+		set_pen(0, 0);
+		const term_caps& cap = caps();
+		add_cap(out, cap.csr, top, bot);
+		const char* many = (n > 0) ? cap.indn : cap.rin;
+		const char* one = (n > 0) ? cap.ind : cap.ri;
+		if (many && (std::abs(n) > 2 || !one)) {
+			add_cap(out, many, std::abs(n));
+		} else {
+			// Index at the bottom of the region, reverse index at the top
+			add_cap(out, cap.cup, (n > 0) ? bot : top, 0);
+			for (int i = 0; i < std::abs(n); i++)
+				out += one;
+		}
+		add_cap(out, cap.csr, 0, front_lines - 1);
+		cur_y = cur_x = -1;
+
+		term_cell* first = &front[(size_t) top * front_cols];
+		term_cell* last = &front[(size_t) (bot + 1) * front_cols];
+		size_t cells = (size_t) std::abs(n) * front_cols;
+		if (n > 0) {
+			std::copy(first + cells, last, first);
+			std::fill(last - cells, last, term_cell{' ', 0, 0, 0});
+			std::copy(&front_hash[top + n], &front_hash[bot + 1], &front_hash[top]);
+		} else {
+			std::copy_backward(first, last - cells, last);
+			std::fill(first, first + cells, term_cell{' ', 0, 0, 0});
+			std::copy_backward(&front_hash[top], &front_hash[bot + 1 + n], &front_hash[bot + 1]);
+		}
+		size_t blank = hash_row(n > 0 ? last - front_cols : first);
+		for (int y = (n > 0) ? bot - n + 1 : top; y <= ((n > 0) ? bot : top - n - 1); y++)
+			front_hash[y] = blank;
+	}
+
+	// Finds rows of the new frame that the terminal already shows a number of rows up or down (as when a window
+	// scrolls); if moving them there is worth it, the terminal scrolls them instead of having them drawn again
+	void find_scroll() {
+		const term_caps& cap = caps();
+		if (!cap.csr)
+			return;
+		// Rows that changed vote for the distance to the one row that showed them before
+		shown_rows.clear();
+		for (int y = 0; y < front_lines; y++)
+			shown_rows.push_back({front_hash[y], y});
+		std::sort(shown_rows.begin(), shown_rows.end());
+		for (size_t i = 1; i < shown_rows.size(); i++)
+			if (shown_rows[i].first == shown_rows[i - 1].first)
+				shown_rows[i].second = shown_rows[i - 1].second = -1;
+		votes.assign(2 * front_lines, 0);
+		for (int y = 0; y < front_lines; y++) {
+			if (back_hash[y] == front_hash[y])
+				continue;
+			auto it = std::lower_bound(shown_rows.begin(), shown_rows.end(), std::make_pair(back_hash[y], -1));
+			if (it != shown_rows.end() && it->first == back_hash[y] && it->second >= 0)
+				votes[it->second - y + front_lines]++;
+		}
+		int n = 0, most = 0;
+		for (int d = 1 - front_lines; d < front_lines; d++) {
+			int v = votes[d + front_lines];
+			if (v > most || (v > 0 && v == most && std::abs(d) < std::abs(n))) {
+				n = d;
+				most = v;
+			}
+		}
+		if (n == 0 || !((n > 0) ? cap.ind || cap.indn : cap.ri || cap.rin))
+			return;
+
+		// Longest stretch of rows that are all found n rows further down (up if negative)
+		int best_top = 0, best_gain = 0, best_len = 0;
+		for (int y = std::max(0, -n); y < std::min(front_lines, front_lines - n);) {
+			int top = y, gain = 0;
+			for (; y < std::min(front_lines, front_lines - n) && back_hash[y] == front_hash[y + n]
+			    && same(&back[(size_t) y * front_cols], &front[(size_t) (y + n) * front_cols], front_cols); y++)
+				gain += back_hash[y] != front_hash[y];
+			if (gain > best_gain) {
+				best_top = top;
+				best_gain = gain;
+				best_len = y - top;
+			}
+			if (y == top)
+				y++;
+		}
+		// Scrolling costs a few sequences, and the rows it frees have to be drawn again
+		if (best_gain < 2 || best_len <= std::abs(n))
+			return;
+		if (n > 0)
+			scroll_front(best_top, best_top + best_len - 1 + n, n);
+		else
+			scroll_front(best_top + n, best_top + best_len - 1, n);
+	}
+
+	void reset_output() {
+		write_unsent(true);
+		if (pen_attr != 0 || pen_pair != 0) {
+			write_out(caps().sgr0 ? caps().sgr0 : "\033[m");
+			pen_attr = 0;
+			pen_pair = 0;
+		}
+	}
+
+	// After a resize (or before the first frame), ncurses draws the whole screen; after that, frames are diffed against it
+	void start_over() {
+		reset_output();
+		clearok(curscr, TRUE);
+		doupdate();
+		front_lines = LINES;
+		front_cols = COLS;
+		front.resize((size_t) front_lines * front_cols);
+		back.resize(front.size());
+		front_hash.resize(front_lines);
+		back_hash.resize(front_lines);
+		line.resize(front_cols + 1);
+		getyx(curscr, cur_y, cur_x);
+		for (int y = 0; y < front_lines; y++) {
+			read_row(curscr, y, &front[(size_t) y * front_cols]);
+			front_hash[y] = hash_row(&front[(size_t) y * front_cols]);
+		}
+		wmove(curscr, cur_y, cur_x);
+		pair_colors.clear();
+	}
+
+	void resync_output() {
+		if (writes_directly())
+			start_over();
+	}
+
+	void flush_output() {
+		write_unsent(false);
+	}
+
+	// The terminal is behind while it has not taken all of the last frame, has no room for more output, has more than
+	// max_queued_output bytes left to send (as on a slow serial line), or took long to take the last frame and has not
+	// had that long again to send it on
+	bool skip_frame() {
+		if (max_queued_output <= 0)
+			return false;
+		bool behind = !write_unsent(false);
+		pollfd p{STDOUT_FILENO, POLLOUT, 0};
+		behind = behind || poll(&p, 1, 0) == 0;
+		int queued = 0;
+		behind = behind || (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) == 0 && queued > max_queued_output);
+		// Taking a frame only takes milliseconds when the terminal is not keeping up
+		behind = behind || (write_latency >= 5000 && since(frame_end) < write_latency);
+		if (behind) {
+			frames_skipped++;
+			clock_gettime(CLOCK_MONOTONIC, &last_skip);
+		}
+		return behind;
+	}
+
+	bool dropping_frames() {
+		return frames_skipped > 0 && since(last_skip) < 1000000;
+	}
+
+	// Reads rows from to to of newscr into `back` (the ones it has not touched are taken from `front`); returns whether
+	// any of them changed
+	bool read_frame(int from, int to) {
+		bool changed = false;
+		for (int r = from; r <= to; r++) {
+			term_cell* dest = &back[(size_t) r * front_cols];
+			if (is_linetouched(newscr, r)) {
+				read_row(newscr, r, dest);
+				back_hash[r] = hash_row(dest);
+			} else {
+				std::copy_n(&front[(size_t) r * front_cols], front_cols, dest);
+				back_hash[r] = front_hash[r];
+			}
+			changed |= back_hash[r] != front_hash[r];
+		}
+		return changed;
+	}
+
+	// Adds what it takes to turn rows from to to of `front` into those of `back` to `out`
+	void draw_rows(int from, int to) {
+		const term_caps& cap = caps();
+		for (int r = from; r <= to; r++) {
+			row = &back[(size_t) r * front_cols];
+			term_cell* old = &front[(size_t) r * front_cols];
+			if (back_hash[r] == front_hash[r] && same(row, old, front_cols))
+				continue;
+			for (int c = 0; c < front_cols; c++) {
+				if (row[c].ch == 0 || same(&row[c], &old[c]))
+					continue;
+				// Terminals without xenl would scroll after the bottom right cell
+				if (!cap.xenl && r == front_lines - 1 && c == front_cols - 1)
+					continue;
+				// Runs of blanks are erased rather than written out
+				int n = 1;
+				if (can_erase(row[c])) {
+					while (c + n < front_cols && same(&row[c + n], &row[c]))
+						n++;
+				}
+				if (n >= ((c + n == front_cols) ? 4 : 8)) {
+					move_to(r, c);
+					set_pen(row[c].attr, row[c].pair);
+					add_cap(out, cap.ech, n);
+					std::copy_n(&row[c], n, &old[c]);
+					c += n - 1;
+					continue;
+				}
+				// A few unchanged cells drawn the same way are written over rather than skipped
+				if (cur_y == r && cur_x >= 0 && cur_x < c && c - cur_x <= 3) {
+					bool over = true;
+					for (int g = cur_x; g < c; g++)
+						over &= row[g].attr == pen_attr && row[g].pair == pen_pair;
+					if (over && row[cur_x].ch != 0)
+						for (int g = cur_x; g < c; g++)
+							if (row[g].ch != 0)
+								put(r, g);
+				}
+				put(r, c);
+			}
+			front_hash[r] = hash_row(old);
+		}
+	}
+
+	void update_screen() {
+		if (!writes_directly()) {
+			// doupdate blocks until the terminal has taken the whole frame
+			clock_gettime(CLOCK_MONOTONIC, &frame_start);
+			doupdate();
+			clock_gettime(CLOCK_MONOTONIC, &frame_end);
+			write_latency = since(frame_start);
+			return;
+		}
+		if (front_lines != LINES || front_cols != COLS) {
+			start_over();
+			return;
+		}
+		// Until the terminal has taken the last frame, newscr keeps what changed for the next one
+		if (!write_unsent(max_queued_output <= 0)) {
+			frames_skipped++;
+			clock_gettime(CLOCK_MONOTONIC, &last_skip);
+			return;
+		}
+		int y, x;
+		getyx(newscr, y, x);
+		out.clear();
+		if (read_frame(0, front_lines - 1)) {
+			find_scroll();
+			draw_rows(0, front_lines - 1);
+		}
+		wtouchln(newscr, 0, front_lines, 0);
+		wmove(newscr, y, x);
+		move_to(y, x);
+		if (!out.empty()) {
+			unsent.swap(out);
+			clock_gettime(CLOCK_MONOTONIC, &frame_start);
+			write_unsent(max_queued_output <= 0);
+		}
+	}
+
+	void update_rows(int from, int to) {
+		if (!writes_directly() || front_lines != LINES || front_cols != COLS)
+			return;
+		from = std::max(from, 0);
+		to = std::min(to, front_lines - 1);
+		if (from > to)
+			return;
+		int y = cur_y, x = cur_x;
+		out.clear();
+		if (read_frame(from, to))
+			draw_rows(from, to);
+		wtouchln(newscr, from, to - from + 1, 0);
+		// The cursor goes back to where the last frame left it
+		if (y >= 0 && x >= 0)
+			move_to(y, x);
+		if (!out.empty()) {
+			if (unsent.empty())
+				clock_gettime(CLOCK_MONOTONIC, &frame_start);
+			unsent += out;
+			write_unsent(false);
+		}
+	}
+}
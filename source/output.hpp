@@ -0,0 +1,17 @@
+#ifndef RWM_OUTPUT_H
+#define RWM_OUTPUT_H
+
+namespace rwm {
+	extern bool direct_output;                       // Write frames to the terminal directly instead of through ncurses' doupdate (UTF-8 terminals only)
+	extern int max_queued_output;                    // Bytes the terminal may have left to send before frames are skipped; 0 = never skip frames
+
+	bool writes_directly();                          // Whether frames are written to the terminal directly: direct_output is on, in UTF-8 mode, and the terminal has cup
+	void update_screen();                            // Shows everything marked with wnoutrefresh (like ncurses' doupdate); with direct_output, the terminal is written to without blocking
+	void update_rows(int from, int to);              // Sends the rows from to to of what was marked with wnoutrefresh after what is left of the last frame, even while frames are skipped; the rest waits for the next update_screen (direct_output only)
+	void flush_output();                             // Writes more of the last frame, as much as the terminal takes without blocking (direct_output only)
+	bool skip_frame();                               // Whether the terminal is too far behind to be sent the next frame; the frame then counts as skipped
+	bool dropping_frames();                          // Whether frames have been skipped in the last second
+	void reset_output();                             // Resets the attributes of the terminal; call before endwin
+	void resync_output();                            // Has ncurses redraw the whole screen and diffs frames against that from then on (direct_output only); call before and after ncurses writes to the terminal by itself, as getch does
+}
+#endif
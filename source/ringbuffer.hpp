@@ -0,0 +1,39 @@
+#ifndef RWM_RINGBUFFER_H
+#define RWM_RINGBUFFER_H
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+
+namespace rwm {
+	// Byte queue with a fixed power-of-two capacity; one thread may write while another reads
+	struct ring_buffer {
+		std::vector<char> data;
+		std::atomic<size_t> head{0};    // Total number of bytes written
+		std::atomic<size_t> tail{0};    // Total number of bytes consumed
+
+		ring_buffer(size_t capacity) : data(capacity) {}
+
+		size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+		size_t space() const { return data.size() - size(); }
+
+		// Largest contiguous free area; fill it, then `commit` what was written
+		char* write_area(size_t& len) {
+			size_t h = head.load(std::memory_order_relaxed);
+			size_t pos = h & (data.size() - 1);
+			len = std::min(data.size() - (h - tail.load(std::memory_order_acquire)), data.size() - pos);
+			return &data[pos];
+		}
+		void commit(size_t n) { head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+
+		// Largest contiguous area of unread data, skipping the first `offset` bytes; `consume` what was used
+		const char* read_area(size_t& len, size_t offset = 0) const {
+			size_t t = tail.load(std::memory_order_relaxed) + offset;
+			size_t pos = t & (data.size() - 1);
+			len = std::min(head.load(std::memory_order_acquire) - t, data.size() - pos);
+			return &data[pos];
+		}
+		void consume(size_t n) { tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release); }
+	};
+}
+#endif
@@ -3,14 +3,25 @@
 #include <pty.h>
 #include <spawn.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <time.h>
 #include "windows.hpp"
 #include "rwm.h"
+#include "events.hpp"
+#include "input.hpp"
+#include "threadpool.hpp"
 #include "desktop.hpp"
 #include "charencoding.hpp"
+#include "output.hpp"
 
 namespace rwm {
 	const std::string version = "0.9";
-	int sleep_time = 0;
+	int parse_quantum = 16384;
+	int focused_quantum = 65536;
+	int parse_budget = 5000;
+	int max_fps = 60;
+	int sync_timeout = 150;
+	int refresh_rate[3] = {60, 10, 0};
 	// Key Codes
 	std::unordered_map<int, std::string> key_conversion = {
 		// Normal
@@ -141,15 +152,21 @@ namespace rwm {
 		{BUTTON4_RELEASED, 64},
 		{BUTTON5_RELEASED, 65},
 	};
+	std::vector<int> ungot_keys = {};
 
 
 	void terminate() {
 		rwm_desktop::terminate();
+		close_events();
+		stop_pool();
 		debug_log.close();
 		echo();
 		if (has_colors())
 			use_default_colors();
+		reset_output();
 		endwin();
+		fputs("\033[?2004l", stdout);
+		fflush(stdout);
 		exit(0);
 	}
 
@@ -160,11 +177,18 @@ namespace rwm {
 			c_args.emplace_back(const_cast<char*>(a.c_str()));
 		c_args.push_back(nullptr);
 
-		return posix_spawn(&processID, c_args[0], nullptr, nullptr, &c_args[0], environ);
+		posix_spawnattr_t attr;
+		posix_spawnattr_init(&attr);
+		posix_spawnattr_setsigmask(&attr, &default_signals);
+		posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+		int ret = posix_spawn(&processID, c_args[0], nullptr, &attr, &c_args[0], environ);
+		posix_spawnattr_destroy(&attr);
+		return ret;
 	}
 
 	void init() {
 		setlocale(LC_CTYPE, "");
+		init_events();
 		initscr();
 		init_encoding();
 		cbreak();
@@ -172,44 +196,18 @@ namespace rwm {
 		intrflush(stdscr, FALSE);
 		keypad(stdscr, TRUE);
 		mousemask(MOUSE_MASK, NULL);
+		// Have the terminal mark pastes so they can be forwarded in bulk
+		fputs("\033[?2004h", stdout);
+		fflush(stdout);
 		nonl();
 		raw();
 		set_escdelay(0);
 		mouseinterval(0);
 		timeout(0);
+		init_input();
 		bold_mode = BOLD;
 
-		if (has_colors()) {
-			start_color();
-			use_default_colors();
-			assume_default_colors((uint32_t) DEFAULT_COLOR, (uint32_t) (DEFAULT_COLOR >> 32));
-			
-			// Initialise bright colors
-			base_colors = (COLORS < base_colors) ? COLORS : base_colors;
-			max_colors = (COLORS < max_colors) ? COLORS : max_colors;
-			max_color_pairs = (COLOR_PAIRS < max_color_pairs) ? COLOR_PAIRS : max_color_pairs;
-			if (!HAS_EXT_COLOR) {
-				max_colors = (256 < max_colors) ? 256 : max_colors;
-				max_color_pairs = (256 < max_color_pairs) ? 256 : max_color_pairs;
-			}
-
-			for (short i = 8; i < base_colors; i++) {
-				init_color(i, (i & 1) ? 1000 : 500, (i & 2) ? 1000 : 500, (i & 4) ? 1000 : 500);
-			}
-			colors = base_colors;
-
-			for (int i = -1; i < colors; i++) {
-				color_map.insert_or_assign(i, i);
-			}
-
-			if (colors < 16) {
-				for (int i = colors; i < 16; i++) {
-					color_map.insert_or_assign(i, i - colors);
-				}
-			}
-
-			pair_map.insert_or_assign(DEFAULT_COLOR, COLOR_PAIR(0));
-		}
+		init_colors();
 		rwm_desktop::init();
 		rwm_desktop::render();
 	}
@@ -221,6 +219,7 @@ namespace rwm {
 		Window* sel = windows[i];
 		windows.erase(windows.begin() + i);
 		windows.push_back(sel);
+		invalidate_layout();
 
 		if (windows[SEL_WIN]->status & REPORT_FOCUS)
 			windows[SEL_WIN]->send("\033[I");
@@ -238,17 +237,74 @@ namespace rwm {
 		selected_window = true;
 	}
 
-	int get_top_window(ivec2 pos) {
-		for (int i = windows.size() - 1; i >= 0; i--) {
+	// Index of the window on top at each cell of the screen, row by row (-1 = desktop)
+	std::vector<short> top_window;
+	ivec2 layout_size = {0, 0};
+	bool layout_changed = true;  // A window was moved, resized, hidden, restacked or closed since the map was checked
+	bool layout_rebuilt = false; // The map was rebuilt for get_top_window, and update_layout has not said so yet
+
+	void invalidate_layout() {
+		layout_changed = true;
+	}
+
+	bool update_layout() {
+		layout_changed = false;
+		// Screen size, then position, size and visibility of every window from the bottom up
+		static std::vector<intptr_t> layout, key;
+		key.assign({LINES, COLS});
+		for (Window* win : windows) {
+			int y, x, maxy, maxx;
+			getbegyx(win->frame, y, x);
+			getmaxyx(win->frame, maxy, maxx);
+			key.insert(key.end(), {(intptr_t) win, y, x, maxy, maxx, win->status & HIDDEN});
+		}
+		if (key == layout) {
+			bool rebuilt = layout_rebuilt;
+			layout_rebuilt = false;
+			return rebuilt;
+		}
+		layout.swap(key);
+		layout_rebuilt = false;
+
+		layout_size = {LINES, COLS};
+		top_window.assign((size_t) LINES * COLS, -1);
+		for (int i = 0; i < (int) windows.size(); i++) {
+			if (windows[i]->status & HIDDEN)
+				continue;
 			int y, x, maxy, maxx;
 			getbegyx(windows[i]->frame, y, x);
 			getmaxyx(windows[i]->frame, maxy, maxx);
-			if (!(windows[i]->status & HIDDEN) 
-			 && x <= pos.x && pos.x < x + maxx
-			 && y <= pos.y && pos.y < y + maxy)
-			 	return i;
+			for (int r = std::max(y, 0); r < std::min(y + maxy, LINES); r++)
+				std::fill_n(&top_window[(size_t) r * COLS + std::max(x, 0)], std::max(0, std::min(x + maxx, COLS) - std::max(x, 0)), i);
+		}
+		for (Window* win : windows)
+			win->shown_cells = 0;
+		for (short i : top_window)
+			if (i >= 0)
+				windows[i]->shown_cells++;
+
+		// Parts of partly covered windows were not drawn, and uncovered windows may not have been drawn at all
+		for (Window* win : windows) {
+			win->screen.touch_all();
+			win->should_refresh = true;
 		}
-		return -1;
+		return true;
+	}
+
+	bool is_shown(const Window* win, ivec2 pos) {
+		if (pos.y < 0 || pos.x < 0 || pos.y >= layout_size.y || pos.x >= layout_size.x)
+			return false;
+		int i = top_window[(size_t) pos.y * layout_size.x + pos.x];
+		return i >= 0 && i < (int) windows.size() && windows[i] == win;
+	}
+
+	// Only checks the windows again if one was changed since (see invalidate_layout), so lookups cost nothing
+	int get_top_window(ivec2 pos) {
+		if (layout_changed)
+			layout_rebuilt |= update_layout();
+		if (pos.y < 0 || pos.x < 0 || pos.y >= layout_size.y || pos.x >= layout_size.x)
+			return -1;
+		return top_window[(size_t) pos.y * layout_size.x + pos.x];
 	}
 
 	bool is_on_frame(ivec2 pos) {
@@ -260,7 +316,7 @@ namespace rwm {
 		    || y == pos.y || y + maxy - 1 == pos.y;
 	}
 
-	void close_window(int i) {
+	void close_window(int i, bool redraw) {
 		if (i < 0) 
 			return;
 		if (i == SEL_WIN && selected_window) 
@@ -270,163 +326,387 @@ namespace rwm {
 			rwm_desktop::close_window(windows[i]);
 			delete windows[i];
 			windows.erase(windows.begin() + i);
-			full_refresh();
+			invalidate_layout();
+			if (redraw)
+				full_refresh();
 		} else if (DEBUG) {
 			print_debug("Zombie process!");
 		}
 	}
 
 	void full_refresh() {
+		update_layout();
 		rwm_desktop::render();
 		for (int i = 0; i < rwm::windows.size(); i++)
 			rwm::windows[i]->render(i == SEL_WIN && selected_window);
 	}
 
+	void resize_screen() {
+		winsize wsize;
+		if (ioctl(0, TIOCGWINSZ, (char *) &wsize) < 0) {
+			print_debug("TIOCGWINSZ error");
+			return;
+		}
+		resizeterm(wsize.ws_row, wsize.ws_col);
+		invalidate_layout();
+	}
+
+	long elapsed_us(timespec& start) {
+		timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		return (now.tv_sec - start.tv_sec) * 1000000 + (now.tv_nsec - start.tv_nsec) / 1000;
+	}
+
+	// Parses buffered output using deficit round robin: every window may parse its quantum per pass.
+	// Windows are decoded and applied in parallel (see parse_threads), the focused one first, then the others
+	// in turn. Once parse_budget is used up, the windows not started yet are left for the next pass (and go first then).
+	// Whatever a window's output does beyond itself (see needs_main_thread) is applied afterwards, in the same order.
+	// Returns whether any output is left.
+	bool parse_output() {
+		static int next = 0;
+		timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		int n = windows.size();
+		int focused = (selected_window && n > 0) ? SEL_WIN : -1;
+		bool pending = false;
+
+		std::vector<int> order;
+		for (int k = -1; k < n; k++) {
+			int i = (k < 0) ? focused : (next + k) % n;
+			if (i < 0 || (k >= 0 && i == focused) || (windows[i]->status & FROZEN))
+				continue;
+			order.push_back(i);
+		}
+		std::vector<Window*> busy;
+		for (int i : order) {
+			Window* win = windows[i];
+			if (win->readable || win->reader == THREAD_READER)
+				win->receive();
+			if (win->pending() > 0) {
+				win->deficit += (i == focused) ? focused_quantum : parse_quantum;
+				busy.push_back(win);
+			}
+		}
+		std::vector<char> started(busy.size());
+		parallel_for(busy.size(), [&](size_t j) {
+			if (j > 0 && parse_budget > 0 && elapsed_us(start) >= parse_budget)
+				return;
+			started[j] = true;
+			Window* win = busy[j];
+			win->deficit -= win->decode(win->deficit);
+			if (win->apply(true))
+				win->should_refresh = true; // Stays set until the window is rendered
+		});
+
+		int skipped = -1;
+		for (size_t j = 0; j < busy.size(); j++) {
+			if (!started[j]) {
+				if (skipped < 0)
+					skipped = std::find(windows.begin(), windows.end(), busy[j]) - windows.begin();
+				continue;
+			}
+			busy[j]->apply();
+			busy[j]->ring_bell();
+		}
+		init_new_colors();
+
+		for (int i : order) {
+			Window* win = windows[i];
+			if (win->pending() > 0)
+				pending = true;
+			else
+				win->deficit = 0;
+			pending |= win->readable || (win->hung_up && !(win->status & SHOULD_CLOSE));
+		}
+		if (skipped >= 0)
+			next = skipped;
+		else
+			next = (n > 0) ? (next + 1) % n : 0;
+		return pending;
+	}
+
+	bool expire_sync(Window* win) {
+		if (!(win->status & SYNCHRONIZED) || elapsed_us(win->sync_start) < sync_timeout * 1000L)
+			return false;
+		win->synchronize(false);
+		return true;
+	}
+
+	bool is_occluded(int i) {
+		return windows[i]->shown_cells == 0;
+	}
+
+	// Time (us) until window i may be redrawn according to its refresh policy; -1 = not until its policy changes
+	long refresh_delay(int i) {
+		Window* win = windows[i];
+		int policy = (i == SEL_WIN && selected_window) ? REFRESH_FOCUSED : is_occluded(i) ? REFRESH_OCCLUDED : REFRESH_VISIBLE;
+		int rate = (win->refresh_rate[policy] >= 0) ? win->refresh_rate[policy] : refresh_rate[policy];
+		if (win->status & SYNCHRONIZED)
+			return std::max(1L, sync_timeout * 1000L - elapsed_us(win->sync_start));
+		if (rate <= 0)
+			return -1;
+		if (max_fps > 0 && rate >= max_fps)
+			return 0;
+		return std::max(0L, 1000000 / rate - elapsed_us(win->last_render));
+	}
+
+	void unget_key(int key) {
+		ungot_keys.push_back(key);
+	}
+
+	void handle_key(int c, MEVENT& event, bool& is_window_dragged) {
+		if (DEBUG) {
+			print_debug(keyname(c) + std::string(" ") + ((c != 13 && c != 10) ? std::to_string(c) : "\\n"));
+		}
+		if (rwm_desktop::key_priority(c)) 
+			return;
+		
+		switch (c) {
+		case KEY_MOUSE: {
+				ivec2 click_pos = {event.y, event.x};
+				if (SEL_WIN >= 0) {
+					if (event.bstate & MOUSE_PRESSED) {
+						set_selected(get_top_window(click_pos));
+						if (is_on_frame(click_pos))
+							is_window_dragged = rwm_desktop::frame_click(SEL_WIN, click_pos, event.bstate);
+					} else if (event.bstate & MOUSE_RELEASED) {
+						if (is_window_dragged)
+							is_window_dragged = rwm_desktop::frame_click(SEL_WIN, click_pos, event.bstate);
+						set_selected(get_top_window(click_pos));
+					}
+					if (selected_window) {
+						int x, y;
+						getbegyx(windows[SEL_WIN]->win, y, x);
+						switch (windows[SEL_WIN]->mouse_mode) {
+							case 1000: {
+								std::string mouse_msg = {'\033', '[', 'M', mouse_conversion.at(event.bstate & MOUSE_MASK), 
+									(char) (event.x - x + 33), (char) (event.y - y + 33)
+								};
+								if (DEBUG)
+									print_debug(mouse_msg);
+								windows[SEL_WIN]->send(mouse_msg);
+							}
+							break;
+
+							case 1006: {
+								int mouse_state = mouse_conversion_1006.at(event.bstate & MOUSE_MASK);
+								std::string mouse_msg = "\033[<" 
+									+ std::to_string(mouse_state) + ';'
+									+ std::to_string(event.x - x + 1) + ';'
+									+ std::to_string(event.y - y + 1) 
+									+ ((event.bstate & MOUSE_PRESSED) ? 'M' : 'm');
+								if (DEBUG)
+									print_debug(mouse_msg);
+								windows[SEL_WIN]->send(mouse_msg);
+							}
+							break;
+
+
+							default:
+							break;
+						}
+					} else
+						rwm_desktop::mouse_pressed(event);
+				} else
+					rwm_desktop::mouse_pressed(event);
+				move(event.y, event.x);
+			}
+			break;
+
+		case -1:
+			break;
+
+		case KEY_BACKSPACE: case '\b':
+			c = '\b';
+			if (selected_window) {
+				windows[SEL_WIN]->send(c);
+			} else
+				rwm_desktop::key_pressed(c);
+			break;
+
+		default:
+			if (selected_window) {
+				if ((windows[SEL_WIN]->status & APP_CURSOR) && app_key_conversion.find(c) != app_key_conversion.end()) {
+					windows[SEL_WIN]->send(app_key_conversion.at(c));
+				} else if (key_conversion.find(c) != key_conversion.end()) {
+					windows[SEL_WIN]->send(key_conversion.at(c));
+				} else if (c > 276 && c < 313) {
+					int cc = (c - 265) % 12 + 265;
+					int mod = (c - 265) / 12;
+					int shift = mod & 1;
+					int ctrl = (mod & 2) << 1;
+					int alt = (mod & 4) >> 1;
+					std::string code = key_conversion.at(cc).substr(0, 4) + ';' + std::to_string(shift + ctrl + alt) + '~';
+				} else if (c < 256) {
+					windows[SEL_WIN]->send(c);
+				}
+			} else
+				rwm_desktop::key_pressed(c);
+			break;
+			
+		case '\x03':
+			// ^C
+			if (selected_window)  {
+				windows[SEL_WIN]->send(c);
+				windows[SEL_WIN]->status &= ~NO_EXIT;
+			} else
+				rwm_desktop::key_pressed(c);
+			break;
+		}
+	}
+
 	inline int main() {
 		init();
-		doupdate();
+		update_screen();
 		if (DEBUG)
 			debug_log << "==== RESTART ====\n";
 		bool is_window_dragged = false;
+		std::vector<input_event> input;
+		int events = INPUT_EVENT;
+		bool redraw_desktop = false;
+		bool redraw_taskbar = false;
+		bool taskbar_skipping = false;
+		bool relayout = false;
+		bool input_since_frame = false;
+		timespec last_frame;
+		clock_gettime(CLOCK_MONOTONIC, &last_frame);
 
 		while (true) {
-			bool should_refresh = rwm_desktop::update();
-			if (should_refresh)
-				rwm_desktop::render();
-			for (int i = 0; i < windows.size(); i++) {
-				if (!(windows[i]->status & FROZEN)) {
-					int ret = windows[i]->output();
-					should_refresh |= (ret == 1);
-					if ((windows[i]->status & SHOULD_CLOSE) && !(windows[i]->status & NO_EXIT)) {
-						close_window(i);
-						should_refresh = true;
-					} else if (should_refresh && !(windows[i]->status & HIDDEN))
-						windows[i]->render(i == SEL_WIN && selected_window);
-				} else if ((windows[i]->status & FROZEN) && should_refresh)
-					windows[i]->render(i == SEL_WIN && selected_window);
+			if (events & RESIZE_EVENT)
+				resize_screen();
+			if (events & TERMINAL_EVENT)
+				flush_output();
+
+			// Handle all pending input at once; typed keys are queued and sent to each window in as few writes as possible
+			// (the beginning of a key sequence waits a moment for the rest, then is taken as it is)
+			if ((events & INPUT_EVENT) || input_timeout() == 0) {
+				read_input(input);
+				for (input_event& e : input) {
+					if (SEL_WIN < 0)
+						selected_window = false;
+					if (e.key == KEY_PASTE) {
+						if (selected_window) {
+							windows[SEL_WIN]->paste(e.text, e.paste);
+						} else {
+							for (char c : e.text)
+								handle_key((unsigned char) c, e.mouse, is_window_dragged);
+						}
+						continue;
+					}
+					handle_key(e.key, e.mouse, is_window_dragged);
+					while (!ungot_keys.empty()) {
+						int key = ungot_keys.back();
+						ungot_keys.pop_back();
+						handle_key(key, e.mouse, is_window_dragged);
+					}
+				}
+				input_since_frame = true;
 			}
 
-			if (SEL_WIN < 0)
-				selected_window = false;
-			if (should_refresh)
-				doupdate();
-			
-			int c;
-			if (selected_window)
-				c = wgetch(windows[SEL_WIN]->win);
-			else {
-				c = getch();
-				curs_set(0);
+			redraw_desktop |= rwm_desktop::update() || (events & RESIZE_EVENT);
+			// The taskbar shows whether frames are being skipped, so it goes out again when that changes
+			bool skipping = dropping_frames();
+			redraw_taskbar |= skipping != taskbar_skipping;
+			taskbar_skipping = skipping;
+			bool pending = parse_output();
+
+			// Sends typed keys and replies to queries; whatever the processes do not accept yet waits for their masters to become writable
+			for (Window* win : windows)
+				win->flush_input();
+
+			// Output is parsed as it arrives, but the screen is only updated once per frame (or right after input);
+			// windows are only redrawn as often as their refresh policy allows
+			// (windows in the middle of a synchronized update wait for its end, or for sync_timeout)
+			// Windows whose processes have exited are closed right away, even while frames are skipped;
+			// the screen is redrawn with the next frame
+			for (int i = 0; i < (int) windows.size(); i++) {
+				if ((windows[i]->status & SHOULD_CLOSE) && !(windows[i]->status & NO_EXIT)) {
+					size_t n = windows.size();
+					close_window(i, false);
+					if (windows.size() < n) {
+						redraw_desktop = true;
+						i--;
+					}
+				}
 			}
-
-			if (DEBUG && c != -1) {
-				print_debug(keyname(c) + (" " +  (c != 13 && c != 10) ? std::to_string(c) : "\\n"));
+			relayout |= update_layout();
+			std::vector<bool> due(windows.size());
+			bool dirty = redraw_desktop || relayout;
+			long next_due = -1;
+			for (int i = 0; i < (int) windows.size(); i++) {
+				Window* win = windows[i];
+				expire_sync(win);
+				if (win->should_refresh && !(win->status & HIDDEN)) {
+					long delay = (i == SEL_WIN && selected_window && input_since_frame && !(win->status & SYNCHRONIZED)) ? 0 : refresh_delay(i);
+					due[i] = (delay == 0);
+					dirty |= due[i];
+					if (delay > 0 && (next_due < 0 || delay < next_due))
+						next_due = delay;
+				}
 			}
-			if (rwm_desktop::key_priority(c)) 
-				continue;
-			
-			MEVENT event;
-			switch (c) {
-			case KEY_MOUSE:
-				if (getmouse(&event) == OK) {
-					ivec2 click_pos = {event.y, event.x};
-					if (SEL_WIN >= 0) {
-						if (event.bstate & MOUSE_PRESSED) {
-							set_selected(get_top_window(click_pos));
-							if (is_on_frame(click_pos))
-								is_window_dragged = rwm_desktop::frame_click(SEL_WIN, click_pos, event.bstate);
-						} else if (event.bstate & MOUSE_RELEASED) {
-							if (is_window_dragged)
-								is_window_dragged = rwm_desktop::frame_click(SEL_WIN, click_pos, event.bstate);
-							set_selected(get_top_window(click_pos));
-						}
-						if (selected_window) {
-							int x, y;
-							getbegyx(windows[SEL_WIN]->win, y, x);
-							switch (windows[SEL_WIN]->mouse_mode) {
-								case 1000: {
-									std::string mouse_msg = {'\033', '[', 'M', mouse_conversion.at(event.bstate & MOUSE_MASK), 
-										(char) (event.x - x + 33), (char) (event.y - y + 33)
-									};
-									if (DEBUG)
-										print_debug(mouse_msg);
-									windows[SEL_WIN]->send(mouse_msg);
-								}
-								break;
-
-								case 1006: {
-									int mouse_state = mouse_conversion_1006.at(event.bstate & MOUSE_MASK);
-									std::string mouse_msg = "\033[<" 
-										+ std::to_string(mouse_state) + ';'
-										+ std::to_string(event.x - x + 1) + ';'
-										+ std::to_string(event.y - y + 1) 
-										+ ((event.bstate & MOUSE_PRESSED) ? 'M' : 'm');
-									if (DEBUG)
-										print_debug(mouse_msg);
-									windows[SEL_WIN]->send(mouse_msg);
-								}
-								break;
-
-
-								default:
-								break;
-							}
-						} else
-							rwm_desktop::mouse_pressed(event);
-					} else
-						rwm_desktop::mouse_pressed(event);
-					move(event.y, event.x);
+			long frame_time = (max_fps > 0) ? 1000000 / max_fps : 0;
+			long since_frame = elapsed_us(last_frame);
+			int timeout = pending ? 0 : -1;
+
+			// While the terminal is behind (e.g. over a slow link), frames are skipped; processes keep running, and
+			// the first frame after it has caught up shows everything as it is by then
+			bool frame = dirty && (input_since_frame || since_frame >= frame_time);
+			if (frame && skip_frame()) {
+				next_due = std::max(frame_time, 10000L);
+				// With direct_output, the taskbar still goes out after what is left of the last frame, so it shows that
+				// frames are being skipped; the rest of the desktop waits for the next frame, like the windows
+				if (redraw_taskbar && writes_directly()) {
+					rwm_desktop::render_taskbar();
+					update_rows(LINES - 1, LINES - 1);
+					redraw_taskbar = false;
 				}
-				break;
-
-			case -1:
-				break;
+			} else if (frame) {
+				bool should_refresh = redraw_desktop || relayout;
+				if (redraw_desktop)
+					rwm_desktop::render();
+
+				// Windows only draw the cells they are on top at (see update_layout), so only the ones that are due
+				// are redrawn; all of them are after the desktop was redrawn or the layout changed
+				for (int i = 0; i < (int) windows.size(); i++)
+					if ((should_refresh || due[i]) && !(windows[i]->status & HIDDEN))
+						windows[i]->render(i == SEL_WIN && selected_window);
 
-			case KEY_BACKSPACE: case '\b':
-				c = '\b';
-				if (selected_window) {
-					windows[SEL_WIN]->send(c);
-				} else
-					rwm_desktop::key_pressed(c);
-				break;
-
-			default:
-				if (selected_window) {
-					if ((windows[SEL_WIN]->status & APP_CURSOR) && app_key_conversion.find(c) != app_key_conversion.end()) {
-						windows[SEL_WIN]->send(app_key_conversion.at(c));
-					} else if (key_conversion.find(c) != key_conversion.end()) {
-						windows[SEL_WIN]->send(key_conversion.at(c));
-					} else if (c > 276 && c < 313) {
-						int cc = (c - 265) % 12 + 265;
-						int mod = (c - 265) / 12;
-						int shift = mod & 1;
-						int ctrl = (mod & 2) << 1;
-						int alt = (mod & 4) >> 1;
-						std::string code = key_conversion.at(cc).substr(0, 4) + ';' + std::to_string(shift + ctrl + alt) + '~';
-					} else if (c < 256) {
-						windows[SEL_WIN]->send(c);
-					}
-				} else
-					rwm_desktop::key_pressed(c);
-				break;
-				
-			case '\x03':
-				// ^C
-				if (selected_window)  {
-					windows[SEL_WIN]->send(c);
-					windows[SEL_WIN]->status &= ~NO_EXIT;
-				} else
-					rwm_desktop::key_pressed(c);
-				break;
+				if (SEL_WIN < 0)
+					selected_window = false;
+				if (!selected_window)
+					curs_set(0);
+				update_screen();
+				clock_gettime(CLOCK_MONOTONIC, &last_frame);
+				redraw_desktop = false;
+				redraw_taskbar = false;
+				relayout = false;
+				input_since_frame = false;
+
+				// Windows may have been flagged for refresh by windows processed after them
+				for (int i = 0; i < (int) windows.size(); i++)
+					if (windows[i]->should_refresh && !(windows[i]->status & HIDDEN) && refresh_delay(i) == 0)
+						timeout = 0;
+			} else if (dirty) {
+				next_due = frame_time - since_frame;
 			}
-			usleep(sleep_time);
+
+			// Wake up in time for the next frame or the next deferred window redraw
+			if (timeout < 0 && next_due >= 0)
+				timeout = std::max(next_due, frame_time - since_frame + 0L) / 1000 + 1;
+			int key_wait = input_timeout();
+			if (key_wait >= 0 && (timeout < 0 || key_wait < timeout))
+				timeout = key_wait;
+			events = wait_events(timeout);
 		}
 		terminate();
 	}
 };
 
+// The checks in tests/ are linked with the rest of RWM and have their own main()
+#ifndef RWM_NO_MAIN
 int main(int argc, char* argv[]) {
 	rwm_desktop::parse_args(argc, argv);
 	return rwm::main();
 }
+#endif
 
@@ -11,11 +11,22 @@ namespace rwm {
 	void init();                                 // Initialise WM
 	void move_to_top(int i);                     // Move window i to the top
 	void set_selected(int i);                    // Focus window i
-	int get_top_window(ivec2 pos);               // Get top (focused) window
+	int get_top_window(ivec2 pos);               // Get window on top at `pos` (-1 = none)
+	bool update_layout();                        // Rebuilds the map of which window is on top where if windows were moved, resized, hidden or restacked; returns whether it did
+	void invalidate_layout();                    // Marks that a window was moved, resized, hidden, restacked or closed (for get_top_window)
+	bool is_shown(const Window* win, ivec2 pos); // Check if `win` is on top at position `pos` (as of the last update_layout)
 	bool is_on_frame(ivec2 pos);                 // Check if position `pos` lies on frame of top window
-	void close_window(int i);                    // Closes window i
+	void close_window(int i, bool redraw = true); // Closes window i; `redraw` = redraw the screen right away
 	void full_refresh();                         // Fully refreshes the screen
 	int spawn(std::vector<std::string> args);    // Spawns process
-	extern int sleep_time;                       // Time that RWM waits before next refresh
+	extern int parse_quantum;                    // Bytes of output each window may parse per pass
+	extern int focused_quantum;                  // Bytes of output the focused window may parse per pass
+	extern int parse_budget;                     // Time (us) per pass after which remaining output is left for the next pass; 0 = unlimited
+	extern int max_fps;                          // Maximum number of screen updates per second; 0 = unlimited
+	extern int refresh_rate[3];                  // Redraws per second of focused, visible and occluded windows; 0 = only once shown
+	extern int sync_timeout;                     // Time (ms) after which a synchronized update is shown even if it is not done
+	bool parse_output();                         // Parses the buffered output of the windows, as much as parse_budget allows; returns whether any is left
+	bool expire_sync(Window* win);               // Ends the synchronized update of `win` if it has lasted sync_timeout; returns whether it did
+	void unget_key(int key);                     // Pushes key back, to be handled right after the current one (like ncurses' ungetch)
 }
 #endif
\ No newline at end of file
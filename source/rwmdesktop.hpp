@@ -90,6 +90,8 @@ namespace rwm_desktop {
 	void close_fifo();
 	void open_fifo();
 	void read_fifo();
+	void close_clock();
+	void open_clock();
 	void show_info(std::string msg);
 	std::string find_in_path(std::string exe);
 }
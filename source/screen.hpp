@@ -0,0 +1,166 @@
+#ifndef RWM_SCREEN_H
+#define RWM_SCREEN_H
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+namespace rwm {
+	// Character cell of a window
+	struct cell {
+		char32_t ch = ' ';                 // Codepoint; 0 = right half of the wide character left of it
+		char32_t comb = 0;                 // Combining character drawn over it, 0 if there is none
+		uint32_t attr = 0;                 // ncurses attributes (A_BOLD, A_ALTCHARSET, ...) without the color pair
+		int pair = 0;                      // Color pair
+
+		bool operator==(const cell& c) const { return ch == c.ch && comb == c.comb && attr == c.attr && pair == c.pair; }
+		bool operator!=(const cell& c) const { return !(*this == c); }
+	};
+
+	// Contents of a window as drawn by its process; rows that changed since they were last drawn are marked dirty
+	struct screen_buffer {
+		int height = 0, width = 0;
+		std::vector<cell> cells;           // Row by row
+		std::vector<uint64_t> dirty;       // One bit per row
+		int y = 0, x = 0;                  // Cursor
+		int top = 0, bot = -1;             // Scrolling region (rows top to bot)
+
+		cell* row(int y) { return &cells[(size_t) y * width]; }
+		const cell* row(int y) const { return &cells[(size_t) y * width]; }
+
+		bool is_dirty(int y) const { return (dirty[y / 64] >> (y % 64)) & 1; }
+		void touch(int y) { dirty[y / 64] |= 1ULL << (y % 64); }
+		void touch(int from, int to) { for (int y = std::max(from, 0); y <= to && y < height; y++) touch(y); }
+		void touch_all() { touch(0, height - 1); }
+		void clean() { std::fill(dirty.begin(), dirty.end(), 0); }
+
+		// Keeps what fits, like ncurses' wresize; the scrolling region only stays the whole screen if it was
+		void resize(int h, int w) {
+			h = std::max(h, 1);
+			w = std::max(w, 1);
+			std::vector<cell> old(std::move(cells));
+			cells.assign((size_t) h * w, cell{});
+			for (int i = 0; i < std::min(h, height); i++) {
+				if (w < width && old[(size_t) i * width + w].ch == 0)
+					old[(size_t) i * width + w - 1].ch = ' ';
+				std::copy_n(&old[(size_t) i * width], std::min(w, width), &cells[(size_t) i * w]);
+			}
+			bool whole = (top == 0 && bot == height - 1) || bot < 0;
+			height = h;
+			width = w;
+			dirty.assign((h + 63) / 64, 0);
+			touch_all();
+			if (whole || bot >= h || top >= bot) {
+				top = 0;
+				bot = h - 1;
+			}
+			move(y, x);
+		}
+
+		void move(int y, int x) {
+			this->y = std::max(0, std::min(y, height - 1));
+			this->x = std::max(0, std::min(x, width - 1));
+		}
+
+		// Same check as ncurses' wsetscrreg; returns false (and keeps the region) if it is not valid
+		bool set_region(int top, int bot) {
+			if (top < 0 || bot >= height || top >= bot)
+				return false;
+			this->top = top;
+			this->bot = bot;
+			return true;
+		}
+
+		// Splits the wide character at column x (if there is one) before part of it is overwritten
+		void split_wide(int y, int x) {
+			if (x < 0 || x >= width)
+				return;
+			cell* r = row(y);
+			if (r[x].ch == 0 && x > 0)
+				r[x - 1].ch = r[x].ch = ' ';
+			if (x + 1 < width && r[x + 1].ch == 0)
+				r[x].ch = r[x + 1].ch = ' ';
+		}
+
+		// Puts a character of w columns at column x of row y; a combining character (w = 0) goes on the character left of it
+		void put(int y, int x, cell c, int w) {
+			if (w == 0) {
+				if (x > 0 && row(y)[x - 1].ch == 0)
+					x--;
+				if (x > 0 && row(y)[x - 1].comb == 0)
+					row(y)[x - 1].comb = c.ch;
+				return;
+			}
+			split_wide(y, x);
+			if (w > 1)
+				split_wide(y, x + 1);
+			cell* r = row(y);
+			r[x] = c;
+			if (w > 1 && x + 1 < width) {
+				c.ch = 0;
+				c.comb = 0;
+				r[x + 1] = c;
+			}
+		}
+
+		// Fills columns from to to - 1 of row y
+		void fill(int y, int from, int to, cell c) {
+			from = std::max(from, 0);
+			to = std::min(to, width);
+			if (from >= to)
+				return;
+			split_wide(y, from);
+			split_wide(y, to - 1);
+			std::fill(row(y) + from, row(y) + to, c);
+			touch(y);
+		}
+
+		void clear(cell c = cell{}) {
+			std::fill(cells.begin(), cells.end(), c);
+			touch_all();
+		}
+
+		// Shifts row y right of the cursor column x by n columns (left if negative), filling what is freed with c
+		void shift(int y, int x, int n, cell c) {
+			cell* r = row(y);
+			// On the right half of a wide character, columns are inserted or deleted after it (as in ncurses)
+			if (x > 0 && x < width && r[x].ch == 0)
+				x++;
+			n = std::max(x - width, std::min(n, width - x));
+			if (n == 0)
+				return;
+			// Wide characters cut where columns drop out are blanked
+			int cut = (n > 0) ? width - n : x - n;
+			if (cut < width && r[cut].ch == 0)
+				r[cut - 1].ch = r[cut].ch = ' ';
+			if (n > 0) {
+				std::copy_backward(r + x, r + width - n, r + width);
+				std::fill(r + x, r + x + n, c);
+			} else {
+				std::copy(r + x - n, r + width, r + x);
+				std::fill(r + width + n, r + width, c);
+			}
+			touch(y);
+		}
+
+		// Scrolls rows top to bot up by n rows (down if negative), filling what is freed with c
+		void scroll_rows(int top, int bot, int n, cell c = cell{}) {
+			top = std::max(top, 0);
+			bot = std::min(bot, height - 1);
+			int rows = bot - top + 1;
+			if (rows <= 0 || n == 0)
+				return;
+			n = std::max(-rows, std::min(n, rows));
+			cell* first = row(top);
+			cell* last = row(bot) + width;
+			if (n > 0) {
+				std::copy(first + (size_t) n * width, last, first);
+				std::fill(last - (size_t) n * width, last, c);
+			} else {
+				std::copy_backward(first, last + (size_t) n * width, last);
+				std::fill(first, first - (size_t) n * width, c);
+			}
+			touch(top, bot);
+		}
+	};
+}
+#endif
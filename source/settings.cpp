@@ -2,6 +2,10 @@
 #include <unordered_set>
 #include "rwmdesktop.hpp"
 #include "rwm.h"
+#include "events.hpp"
+#include "threadpool.hpp"
+#include "uring.hpp"
+#include "output.hpp"
 
 namespace rwm_settings {
 	std::unordered_map<std::string, std::string*> string_vars = {
@@ -34,12 +38,23 @@ namespace rwm_settings {
 	std::unordered_map<std::string, std::pair<int*, size_t>> int_vars = {
 		{"task_tab_size", {&rwm_desktop::tab_size, 1}},
 		{"default_window_size", {&rwm_desktop::win_size.y, 2}},
-		{"refresh_rate", {&rwm::sleep_time, 1}},
+		{"parse_quantum", {&rwm::parse_quantum, 1}},
+		{"focused_quantum", {&rwm::focused_quantum, 1}},
+		{"parse_budget", {&rwm::parse_budget, 1}},
+		{"max_fps", {&rwm::max_fps, 1}},
+		{"refresh_rate", {&rwm::refresh_rate[0], 3}},
+		{"parse_threads", {&rwm::parse_threads, 1}},
+		{"jump_scroll", {&rwm::jump_scroll, 1}},
+		{"sync_timeout", {&rwm::sync_timeout, 1}},
+		{"max_queued_output", {&rwm::max_queued_output, 1}},
 	};
 
 	std::unordered_map<std::string, bool*> bool_vars = {
 		{"draw_icons", &rwm_desktop::should_draw_icons},
-		{"force_convert", &rwm::force_convert}
+		{"force_convert", &rwm::force_convert},
+		{"reader_thread", &rwm::reader_thread},
+		{"io_uring", &rwm::use_io_uring},
+		{"direct_output", &rwm::direct_output}
 	};
 
 	void set_str(std::unordered_map<const std::string, std::string*>::iterator it, std::string value) {
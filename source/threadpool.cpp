@@ -0,0 +1,110 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "threadpool.hpp"
+
+namespace rwm {
+	int parse_threads = 0;
+
+	std::vector<std::thread> workers = {};
+	std::mutex pool_mutex;
+	std::condition_variable work_ready;                         // Signalled when a new batch is started (or the pool is stopped)
+	std::condition_variable work_done;                          // Signalled when the last task of a batch has finished
+	const std::function<void(size_t)>* batch_task = nullptr;
+	size_t batch_size = 0;
+	std::atomic<uint64_t> next_task{0};                         // Batch number (high 32 bits) and index (low 32 bits) of the next task to be picked up
+	size_t tasks_left = 0;                                      // Tasks of the current batch that have not finished yet
+	unsigned batch_no = 0;                                      // Incremented for every batch, so workers know when there is new work
+	bool stopping = false;
+
+	// Tasks are picked up one at a time from one shared counter, so a thread that is done with a short task immediately
+	// takes the next one (there are no per-thread queues to steal from: a batch is at most one task per window);
+	// a task is only taken while its batch is still the current one, so a thread that finds a batch finished
+	// cannot take a task of the next one for it
+	void run_tasks(unsigned batch, const std::function<void(size_t)>* task, size_t size) {
+		size_t done = 0;
+		uint64_t next = next_task.load();
+		while ((unsigned) (next >> 32) == batch && (next & 0xffffffff) < size) {
+			if (!next_task.compare_exchange_weak(next, next + 1))
+				continue;
+			(*task)(next & 0xffffffff);
+			done++;
+			next = next_task.load();
+		}
+		if (done > 0) {
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			tasks_left -= done;
+			if (tasks_left == 0)
+				work_done.notify_all();
+		}
+	}
+
+	void work() {
+		unsigned seen = 0;
+		while (true) {
+			const std::function<void(size_t)>* task;
+			size_t size;
+			{
+				std::unique_lock<std::mutex> lock(pool_mutex);
+				work_ready.wait(lock, [&]{ return stopping || batch_no != seen; });
+				if (stopping)
+					return;
+				seen = batch_no;
+				task = batch_task;
+				size = batch_size;
+			}
+			run_tasks(seen, task, size);
+		}
+	}
+
+	void start_pool(int threads) {
+		stop_pool();
+		stopping = false;
+		for (int i = 1; i < threads; i++)
+			workers.emplace_back(work);
+	}
+
+	void stop_pool() {
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			stopping = true;
+		}
+		work_ready.notify_all();
+		for (std::thread& t : workers)
+			t.join();
+		workers.clear();
+	}
+
+	void parallel_for(size_t n, const std::function<void(size_t)>& task) {
+		int threads = (parse_threads > 0) ? parse_threads : (int) std::thread::hardware_concurrency();
+		if (threads < 1)
+			threads = 1;
+		if ((size_t) threads != workers.size() + 1)
+			start_pool(threads);
+
+		// Not worth waking other threads for
+		if (n <= 1 || workers.empty()) {
+			for (size_t i = 0; i < n; i++)
+				task(i);
+			return;
+		}
+
+		unsigned batch;
+		{
+			std::lock_guard<std::mutex> lock(pool_mutex);
+			batch_task = &task;
+			batch_size = n;
+			tasks_left = n;
+			batch = ++batch_no;
+			next_task = (uint64_t) batch << 32;
+		}
+		work_ready.notify_all();
+		run_tasks(batch, &task, n);
+
+		std::unique_lock<std::mutex> lock(pool_mutex);
+		work_done.wait(lock, []{ return tasks_left == 0; });
+	}
+}
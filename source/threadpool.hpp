@@ -0,0 +1,12 @@
+#ifndef RWM_THREADPOOL_H
+#define RWM_THREADPOOL_H
+#include <cstddef>
+#include <functional>
+
+namespace rwm {
+	extern int parse_threads;                                                  // Threads used to parse window output; 0 = one per core
+
+	void parallel_for(size_t n, const std::function<void(size_t)>& task);      // Runs task(0) ... task(n - 1) on the thread pool and waits for all of them
+	void stop_pool();                                                          // Stops all worker threads
+}
+#endif
@@ -0,0 +1,330 @@
+#include "uring.hpp"
+#include "windows.hpp"
+
+#ifdef RWM_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include "events.hpp"
+
+namespace rwm {
+	bool use_io_uring = false;
+
+	const int OP_READ_MULTISHOT = 49;               // IORING_OP_READ_MULTISHOT (Linux 6.7); missing from older headers
+	const unsigned URING_BUFFERS = 16;              // Buffers per window (power of two)
+	const unsigned URING_BUFFER_SIZE = 4096;
+
+	// A window's master, read by a multishot read into the window's own buffer ring
+	struct uring_reader {
+		uint64_t id;                                            // User data of the read
+		Window* win;                                            // nullptr once the window stopped watching
+		int fd;
+		uint16_t group = 0;                                     // Buffer group ID
+		io_uring_buf* ring = nullptr;                           // Buffers the kernel may read into (io_uring_buf_ring)
+		char* buffers = nullptr;
+		uint16_t ring_tail = 0;
+		std::deque<std::pair<uint16_t, uint32_t>> filled = {};  // Buffers (ID, length) read into, but not yet moved to the window
+		size_t offset = 0;                                      // Bytes of the first filled buffer already moved
+		bool armed = false;                                     // Multishot read is active
+		bool hung_up = false;
+		bool failed = false;                                    // Kernel does not support reading this way
+	};
+
+	int ring_fd = -1;
+	unsigned sq_entries;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* sq_flags;
+	io_uring_sqe* sqes;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	io_uring_cqe* cqes;
+	void* sq_ring = MAP_FAILED;
+	void* cq_ring = MAP_FAILED;
+	size_t sq_ring_size, cq_ring_size, sqes_size;
+
+	std::unordered_map<uint64_t, uring_reader*> readers = {};  // Map [user data] -> [reader]
+	std::unordered_map<int, uint64_t> reader_ids = {};         // Map [fd] -> [user data]
+	uint64_t next_id = 1;                                      // 0 is used for requests whose completion does not matter
+	std::vector<uint16_t> free_groups = {};
+	uint16_t next_group = 0;
+
+	int uring_enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+		return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+	}
+
+	int uring_register(unsigned opcode, void* arg, unsigned nr_args) {
+		return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+	}
+
+	// Submissions are rare (a window starting or stalling), so every one is submitted right away
+	void submit(const io_uring_sqe& sqe) {
+		unsigned tail = *sq_tail;
+		unsigned index = tail & *sq_mask;
+		sqes[index] = sqe;
+		sq_array[index] = index;
+		__atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+		while (uring_enter(1, 0, 0) == -1 && errno == EINTR);
+	}
+
+	bool init_uring() {
+		if (ring_fd != -1)
+			return true;
+
+		io_uring_params params{};
+		params.flags = IORING_SETUP_CQSIZE;
+		params.cq_entries = 4096;
+		ring_fd = syscall(__NR_io_uring_setup, 64, &params);
+		if (ring_fd == -1)
+			return false;
+
+		// Multishot reads and buffer rings are fairly recent; check before relying on them
+		std::vector<char> probe_buffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op));
+		io_uring_probe* probe = (io_uring_probe*) probe_buffer.data();
+		if (!(params.features & IORING_FEAT_NODROP)
+		 || uring_register(IORING_REGISTER_PROBE, probe, 256) == -1
+		 || probe->last_op < OP_READ_MULTISHOT
+		 || !(probe->ops[OP_READ_MULTISHOT].flags & IO_URING_OP_SUPPORTED)) {
+			close(ring_fd);
+			ring_fd = -1;
+			return false;
+		}
+
+		sq_entries = params.sq_entries;
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP)
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+		cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? sq_ring
+			: mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+		void* sqe_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+		if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqe_map == MAP_FAILED) {
+			close_uring();
+			return false;
+		}
+
+		char* sq = (char*) sq_ring;
+		sq_head = (unsigned*) (sq + params.sq_off.head);
+		sq_tail = (unsigned*) (sq + params.sq_off.tail);
+		sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+		sq_array = (unsigned*) (sq + params.sq_off.array);
+		sq_flags = (unsigned*) (sq + params.sq_off.flags);
+		sqes = (io_uring_sqe*) sqe_map;
+		char* cq = (char*) cq_ring;
+		cq_head = (unsigned*) (cq + params.cq_off.head);
+		cq_tail = (unsigned*) (cq + params.cq_off.tail);
+		cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+		return true;
+	}
+
+	void release(uring_reader* r) {
+		io_uring_buf_reg reg{};
+		reg.bgid = r->group;
+		uring_register(IORING_UNREGISTER_PBUF_RING, &reg, 1);
+		munmap(r->ring, URING_BUFFERS * sizeof(io_uring_buf));
+		delete[] r->buffers;
+		free_groups.push_back(r->group);
+		readers.erase(r->id);
+		delete r;
+	}
+
+	void close_uring() {
+		if (ring_fd == -1)
+			return;
+		while (!readers.empty())
+			release(readers.begin()->second);
+		reader_ids.clear();
+		if (sqes)
+			munmap(sqes, sqes_size);
+		if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+			munmap(cq_ring, cq_ring_size);
+		if (sq_ring != MAP_FAILED)
+			munmap(sq_ring, sq_ring_size);
+		sqes = nullptr;
+		sq_ring = cq_ring = MAP_FAILED;
+		close(ring_fd);
+		ring_fd = -1;
+	}
+
+	int uring_fd() {
+		return ring_fd;
+	}
+
+	void recycle(uring_reader* r, uint16_t bid) {
+		io_uring_buf& buf = r->ring[r->ring_tail & (URING_BUFFERS - 1)];
+		buf.addr = (uint64_t) (r->buffers + bid * URING_BUFFER_SIZE);
+		buf.len = URING_BUFFER_SIZE;
+		buf.bid = bid;
+		r->ring_tail++;
+		// The tail overlays the first buffer's resv field (io_uring_buf_ring's flexible array does not lay out right in C++)
+		__atomic_store_n(&r->ring[0].resv, r->ring_tail, __ATOMIC_RELEASE);
+	}
+
+	void arm(uring_reader* r) {
+		io_uring_sqe sqe{};
+		sqe.opcode = OP_READ_MULTISHOT;
+		sqe.fd = r->fd;
+		sqe.flags = IOSQE_BUFFER_SELECT;
+		sqe.buf_group = r->group;
+		sqe.user_data = r->id;
+		submit(sqe);
+		r->armed = true;
+	}
+
+	bool uring_watch(int fd, Window* win) {
+		if (!init_uring())
+			return false;
+
+		uring_reader* r = new uring_reader{next_id++, win, fd};
+		if (!free_groups.empty()) {
+			r->group = free_groups.back();
+			free_groups.pop_back();
+		} else
+			r->group = next_group++;
+		r->buffers = new char[URING_BUFFERS * URING_BUFFER_SIZE];
+		r->ring = (io_uring_buf*) mmap(nullptr, URING_BUFFERS * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_SHARED, -1, 0);
+
+		// Touch the ring before registering it, so the kernel does not pin the shared zero page
+		if (r->ring != MAP_FAILED)
+			memset(r->ring, 0, URING_BUFFERS * sizeof(io_uring_buf));
+		io_uring_buf_reg reg{};
+		reg.ring_addr = (uint64_t) r->ring;
+		reg.ring_entries = URING_BUFFERS;
+		reg.bgid = r->group;
+		if (r->ring == MAP_FAILED || uring_register(IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+			if (r->ring != MAP_FAILED)
+				munmap(r->ring, URING_BUFFERS * sizeof(io_uring_buf));
+			delete[] r->buffers;
+			free_groups.push_back(r->group);
+			delete r;
+			return false;
+		}
+		for (uint16_t bid = 0; bid < URING_BUFFERS; bid++)
+			recycle(r, bid);
+
+		readers.insert_or_assign(r->id, r);
+		reader_ids.insert_or_assign(fd, r->id);
+		arm(r);
+		return true;
+	}
+
+	bool uring_unwatch(int fd) {
+		auto it = reader_ids.find(fd);
+		if (it == reader_ids.end())
+			return false;
+		uring_reader* r = readers.at(it->second);
+		reader_ids.erase(it);
+		r->win = nullptr;
+
+		// The buffers may only be freed once the kernel is done with the read
+		if (r->armed) {
+			io_uring_sqe sqe{};
+			sqe.opcode = IORING_OP_ASYNC_CANCEL;
+			sqe.fd = -1;
+			sqe.addr = r->id;
+			submit(sqe);
+		} else
+			release(r);
+		return true;
+	}
+
+	void uring_reap() {
+		if (ring_fd == -1)
+			return;
+		// Completions that did not fit into the completion queue are only handed over when asked for
+		if (__atomic_load_n(sq_flags, __ATOMIC_RELAXED) & IORING_SQ_CQ_OVERFLOW)
+			uring_enter(0, 0, IORING_ENTER_GETEVENTS);
+
+		unsigned head = *cq_head;
+		unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++) {
+			io_uring_cqe& cqe = cqes[head & *cq_mask];
+			auto it = readers.find(cqe.user_data);
+			if (it == readers.end())
+				continue;
+			uring_reader* r = it->second;
+
+			if (cqe.res > 0)
+				r->filled.push_back({cqe.flags >> IORING_CQE_BUFFER_SHIFT, cqe.res});
+			else if (cqe.res == 0 || cqe.res == -EIO)
+				r->hung_up = true;
+			else if (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP || cqe.res == -EBADFD)
+				r->failed = true;
+			// Anything else (-ENOBUFS, -ECANCELED) just ends the read; it is started again once buffers are free
+
+			if (!(cqe.flags & IORING_CQE_F_MORE))
+				r->armed = false;
+			if (!r->win && !r->armed)
+				release(r);
+			else if (r->win)
+				r->win->readable = true;
+		}
+		__atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+	}
+
+	int uring_receive(Window* win, ring_buffer& buffer) {
+		auto it = reader_ids.find(win->master);
+		if (it == reader_ids.end())
+			return READ_AGAIN;
+		uring_reader* r = readers.at(it->second);
+
+		if (r->failed && r->filled.empty()) {
+			// Fall back to reading the master directly
+			use_io_uring = false;
+			uring_unwatch(win->master);
+			watch(win->master, win);
+			return READ_AGAIN;
+		}
+
+		while (!r->filled.empty()) {
+			uint16_t bid = r->filled.front().first;
+			size_t len = r->filled.front().second;
+			size_t space;
+			char* area = buffer.write_area(space);
+			if (space == 0)
+				return READ_FULL;
+			size_t n = std::min(space, len - r->offset);
+			memcpy(area, r->buffers + bid * URING_BUFFER_SIZE + r->offset, n);
+			buffer.commit(n);
+			r->offset += n;
+			if (r->offset == len) {
+				recycle(r, bid);
+				r->offset = 0;
+				r->filled.pop_front();
+			}
+		}
+
+		// All buffers are free again
+		if (!r->armed && !r->hung_up && !r->failed)
+			arm(r);
+		return r->hung_up ? READ_HUP : READ_AGAIN;
+	}
+}
+
+#else
+
+namespace rwm {
+	bool use_io_uring = false;
+
+	bool init_uring() { return false; }
+	void close_uring() {}
+	int uring_fd() { return -1; }
+	bool uring_watch(int, Window*) { return false; }
+	bool uring_unwatch(int) { return false; }
+	void uring_reap() {}
+	int uring_receive(Window*, ring_buffer&) { return READ_AGAIN; }
+}
+#endif
@@ -0,0 +1,25 @@
+#ifndef RWM_URING_H
+#define RWM_URING_H
+#include "ringbuffer.hpp"
+
+// The io_uring backend is built whenever the kernel headers are there (disable with -DRWM_NO_IO_URING)
+#if !defined(RWM_NO_IO_URING) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define RWM_IO_URING
+#endif
+#endif
+
+namespace rwm {
+	struct Window;
+
+	extern bool use_io_uring;                                  // Read the output of new windows through io_uring (if the kernel supports it)
+
+	bool init_uring();                                         // Sets up the io_uring instance if needed; returns false if it is not available
+	void close_uring();                                        // Tears down the io_uring instance
+	int uring_fd();                                            // File descriptor that becomes readable when reads have completed; -1 if not set up
+	bool uring_watch(int fd, Window* win);                     // Starts reading `fd` into `win`; returns false if io_uring is not available
+	bool uring_unwatch(int fd);                                // Stops reading `fd`; returns false if it was not read through io_uring
+	void uring_reap();                                         // Handles completed reads and marks their windows as readable
+	int uring_receive(Window* win, ring_buffer& buffer);       // Moves completed reads of `win` into `buffer`; returns READ_RESULT
+}
+#endif
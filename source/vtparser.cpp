@@ -0,0 +1,318 @@
+#include <algorithm>
+#include "vtparser.hpp"
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+namespace rwm {
+	typedef std::array<std::array<uint8_t, 256>, VT_STATES> vt_transitions;
+
+	constexpr void vt_range(vt_transitions& table, int state, int from, int to, int action, int next) {
+		for (int c = from; c <= to; c++)
+			table[state][c] = (action << 4) | next;
+	}
+
+	// C0 control characters other than CAN, SUB and ESC, which abort sequences
+	constexpr void vt_controls(vt_transitions& table, int state, int action, int next) {
+		vt_range(table, state, 0x00, 0x17, action, next);
+		vt_range(table, state, 0x19, 0x19, action, next);
+		vt_range(table, state, 0x1C, 0x1F, action, next);
+	}
+
+	constexpr vt_transitions build_vt_table() {
+		vt_transitions table{};
+		// Unlisted bytes are ignored
+		for (int state = 0; state < VT_STATES; state++)
+			vt_range(table, state, 0x00, 0xFF, VT_NONE, state);
+
+		// Bytes from 0x80 up are UTF-8 text, not C1 controls
+		vt_controls(table, VT_GROUND, VT_EXECUTE, VT_GROUND);
+		vt_range(table, VT_GROUND, 0x20, 0x7E, VT_PRINT, VT_GROUND);
+		vt_range(table, VT_GROUND, 0x80, 0xFF, VT_PRINT, VT_GROUND);
+
+		vt_controls(table, VT_ESCAPE, VT_EXECUTE, VT_ESCAPE);
+		vt_range(table, VT_ESCAPE, 0x20, 0x2F, VT_COLLECT, VT_ESCAPE_INTERMEDIATE);
+		vt_range(table, VT_ESCAPE, 0x30, 0x7E, VT_ESC_DISPATCH, VT_GROUND);
+		vt_range(table, VT_ESCAPE, 'P', 'P', VT_NONE, VT_DCS_ENTRY);
+		vt_range(table, VT_ESCAPE, 'X', 'X', VT_NONE, VT_SOS_PM_APC_STRING);
+		vt_range(table, VT_ESCAPE, '[', '[', VT_NONE, VT_CSI_ENTRY);
+		vt_range(table, VT_ESCAPE, ']', ']', VT_NONE, VT_OSC_STRING);
+		vt_range(table, VT_ESCAPE, '^', '_', VT_NONE, VT_SOS_PM_APC_STRING);
+
+		vt_controls(table, VT_ESCAPE_INTERMEDIATE, VT_EXECUTE, VT_ESCAPE_INTERMEDIATE);
+		vt_range(table, VT_ESCAPE_INTERMEDIATE, 0x20, 0x2F, VT_COLLECT, VT_ESCAPE_INTERMEDIATE);
+		vt_range(table, VT_ESCAPE_INTERMEDIATE, 0x30, 0x7E, VT_ESC_DISPATCH, VT_GROUND);
+
+		// ':' separates parameters just like ';' (for colors such as 38:2:r:g:b)
+		vt_controls(table, VT_CSI_ENTRY, VT_EXECUTE, VT_CSI_ENTRY);
+		vt_range(table, VT_CSI_ENTRY, 0x20, 0x2F, VT_COLLECT, VT_CSI_INTERMEDIATE);
+		vt_range(table, VT_CSI_ENTRY, 0x30, 0x3B, VT_PARAM, VT_CSI_PARAM);
+		vt_range(table, VT_CSI_ENTRY, 0x3C, 0x3F, VT_COLLECT, VT_CSI_PARAM);
+		vt_range(table, VT_CSI_ENTRY, 0x40, 0x7E, VT_CSI_DISPATCH, VT_GROUND);
+
+		vt_controls(table, VT_CSI_PARAM, VT_EXECUTE, VT_CSI_PARAM);
+		vt_range(table, VT_CSI_PARAM, 0x20, 0x2F, VT_COLLECT, VT_CSI_INTERMEDIATE);
+		vt_range(table, VT_CSI_PARAM, 0x30, 0x3B, VT_PARAM, VT_CSI_PARAM);
+		vt_range(table, VT_CSI_PARAM, 0x3C, 0x3F, VT_NONE, VT_CSI_IGNORE);
+		vt_range(table, VT_CSI_PARAM, 0x40, 0x7E, VT_CSI_DISPATCH, VT_GROUND);
+
+		vt_controls(table, VT_CSI_INTERMEDIATE, VT_EXECUTE, VT_CSI_INTERMEDIATE);
+		vt_range(table, VT_CSI_INTERMEDIATE, 0x20, 0x2F, VT_COLLECT, VT_CSI_INTERMEDIATE);
+		vt_range(table, VT_CSI_INTERMEDIATE, 0x30, 0x3F, VT_NONE, VT_CSI_IGNORE);
+		vt_range(table, VT_CSI_INTERMEDIATE, 0x40, 0x7E, VT_CSI_DISPATCH, VT_GROUND);
+
+		vt_controls(table, VT_CSI_IGNORE, VT_EXECUTE, VT_CSI_IGNORE);
+		vt_range(table, VT_CSI_IGNORE, 0x40, 0x7E, VT_NONE, VT_GROUND);
+
+		vt_range(table, VT_DCS_ENTRY, 0x20, 0x2F, VT_COLLECT, VT_DCS_INTERMEDIATE);
+		vt_range(table, VT_DCS_ENTRY, 0x30, 0x39, VT_PARAM, VT_DCS_PARAM);
+		vt_range(table, VT_DCS_ENTRY, 0x3A, 0x3A, VT_NONE, VT_DCS_IGNORE);
+		vt_range(table, VT_DCS_ENTRY, 0x3B, 0x3B, VT_PARAM, VT_DCS_PARAM);
+		vt_range(table, VT_DCS_ENTRY, 0x3C, 0x3F, VT_COLLECT, VT_DCS_PARAM);
+		vt_range(table, VT_DCS_ENTRY, 0x40, 0x7E, VT_NONE, VT_DCS_PASSTHROUGH);
+
+		vt_range(table, VT_DCS_PARAM, 0x20, 0x2F, VT_COLLECT, VT_DCS_INTERMEDIATE);
+		vt_range(table, VT_DCS_PARAM, 0x30, 0x39, VT_PARAM, VT_DCS_PARAM);
+		vt_range(table, VT_DCS_PARAM, 0x3A, 0x3A, VT_NONE, VT_DCS_IGNORE);
+		vt_range(table, VT_DCS_PARAM, 0x3B, 0x3B, VT_PARAM, VT_DCS_PARAM);
+		vt_range(table, VT_DCS_PARAM, 0x3C, 0x3F, VT_NONE, VT_DCS_IGNORE);
+		vt_range(table, VT_DCS_PARAM, 0x40, 0x7E, VT_NONE, VT_DCS_PASSTHROUGH);
+
+		vt_range(table, VT_DCS_INTERMEDIATE, 0x20, 0x2F, VT_COLLECT, VT_DCS_INTERMEDIATE);
+		vt_range(table, VT_DCS_INTERMEDIATE, 0x30, 0x3F, VT_NONE, VT_DCS_IGNORE);
+		vt_range(table, VT_DCS_INTERMEDIATE, 0x40, 0x7E, VT_NONE, VT_DCS_PASSTHROUGH);
+
+		vt_controls(table, VT_DCS_PASSTHROUGH, VT_PUT, VT_DCS_PASSTHROUGH);
+		vt_range(table, VT_DCS_PASSTHROUGH, 0x20, 0x7E, VT_PUT, VT_DCS_PASSTHROUGH);
+		vt_range(table, VT_DCS_PASSTHROUGH, 0x80, 0xFF, VT_PUT, VT_DCS_PASSTHROUGH);
+
+		// Like xterm, BEL ends an Operating System Command as well as ST does
+		vt_range(table, VT_OSC_STRING, 0x07, 0x07, VT_NONE, VT_GROUND);
+		vt_range(table, VT_OSC_STRING, 0x20, 0x7E, VT_OSC_PUT, VT_OSC_STRING);
+		vt_range(table, VT_OSC_STRING, 0x80, 0xFF, VT_OSC_PUT, VT_OSC_STRING);
+
+		// CAN and SUB abort any sequence, ESC starts a new one (and ends strings as the first half of ST)
+		for (int state = 0; state < VT_STATES; state++) {
+			vt_range(table, state, 0x18, 0x18, VT_NONE, VT_GROUND);
+			vt_range(table, state, 0x1A, 0x1A, VT_NONE, VT_GROUND);
+			vt_range(table, state, 0x1B, 0x1B, VT_NONE, VT_ESCAPE);
+		}
+		return table;
+	}
+
+	extern constexpr vt_transitions vt_table = build_vt_table();
+
+	// Length of the text at the start of `buffer`, i.e. up to the first C0 control character or DEL
+	size_t text_run_scalar(const char* buffer, size_t len) {
+		size_t i = 0;
+		while (i < len && (unsigned char) buffer[i] >= 0x20 && buffer[i] != 0x7F)
+			i++;
+		return i;
+	}
+
+#ifdef __SSE2__
+	size_t text_run_sse2(const char* buffer, size_t len) {
+		const __m128i controls = _mm_set1_epi8(0x1F);
+		const __m128i del = _mm_set1_epi8(0x7F);
+		size_t i = 0;
+		for (; i + 16 <= len; i += 16) {
+			__m128i bytes = _mm_loadu_si128((const __m128i*) (buffer + i));
+			// There is no unsigned comparison; a byte is at most 0x1F if min(byte, 0x1F) is the byte itself
+			__m128i stop = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(bytes, controls), bytes), _mm_cmpeq_epi8(bytes, del));
+			int mask = _mm_movemask_epi8(stop);
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return i + text_run_scalar(buffer + i, len - i);
+	}
+
+	__attribute__((target("avx2")))
+	size_t text_run_avx2(const char* buffer, size_t len) {
+		const __m256i controls = _mm256_set1_epi8(0x1F);
+		const __m256i del = _mm256_set1_epi8(0x7F);
+		size_t i = 0;
+		for (; i + 32 <= len; i += 32) {
+			__m256i bytes = _mm256_loadu_si256((const __m256i*) (buffer + i));
+			__m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, controls), bytes), _mm256_cmpeq_epi8(bytes, del));
+			unsigned mask = _mm256_movemask_epi8(stop);
+			if (mask)
+				return i + __builtin_ctz(mask);
+		}
+		return i + text_run_sse2(buffer + i, len - i);
+	}
+
+	const bool has_avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+#endif
+
+	size_t text_run(const char* buffer, size_t len) {
+#ifdef __SSE2__
+		return has_avx2 ? text_run_avx2(buffer, len) : text_run_sse2(buffer, len);
+#else
+		return text_run_scalar(buffer, len);
+#endif
+	}
+
+	// Queues the sequence that was read as an action
+	void vt_dispatch(decoder_state& decoder, char type, char final) {
+		decoder.actions.push_back({type, decoder.esc_type, final, (uint32_t) decoder.sequences.size()});
+		decoder.sequences.push_back(decoder.seq);
+	}
+
+	// Actions on leaving `state`
+	void vt_exit(decoder_state& decoder, int state) {
+		if (state == VT_OSC_STRING)
+			vt_dispatch(decoder, OSC_ACTION, 0);
+		else if (state == VT_DCS_PASSTHROUGH)
+			vt_dispatch(decoder, DCS_ACTION, decoder.final);
+	}
+
+	// Actions on entering `state` through `c`
+	void vt_entry(decoder_state& decoder, int state, char c) {
+		vt_sequence& seq = decoder.seq;
+		switch (state) {
+			case VT_ESCAPE: case VT_CSI_ENTRY: case VT_DCS_ENTRY: case VT_OSC_STRING:
+			seq.ctrl.clear();
+			if (state == VT_OSC_STRING)
+				seq.ctrl.push_back(0);
+			seq.collected.clear();
+			seq.string_start = decoder.strings.length();
+			seq.string_length = 0;
+			decoder.esc_type = c;
+			decoder.final = 0;
+			decoder.osc_text = false;
+			break;
+
+			case VT_DCS_PASSTHROUGH:
+			decoder.final = c;
+			break;
+		}
+	}
+
+	// Adds `c` to the OSC/DCS string being read
+	void vt_put(decoder_state& decoder, char c) {
+		decoder.strings += c;
+		decoder.seq.string_length++;
+	}
+
+	void vt_parse(decoder_state& decoder, const char* buffer, size_t len) {
+		vt_sequence& seq = decoder.seq;
+		std::vector<parser_action>& actions = decoder.actions;
+		const uint8_t print = (VT_PRINT << 4) | VT_GROUND;
+		for (size_t i = 0; i < len; i++) {
+			char c = buffer[i];
+			int state = decoder.state;
+			uint8_t transition = vt_table[state][(unsigned char) c];
+			int next = transition & 15;
+
+			if (transition == print) {
+				// Take the whole run of text at once
+				size_t end = i + 1 + text_run(buffer + i + 1, len - i - 1);
+				// The text is not copied; runs that follow each other in the buffer make one action
+				std::string_view* last = (!actions.empty() && actions.back().type == TEXT_ACTION) ? &actions.back().text : nullptr;
+				if (last && last->data() + last->length() == buffer + i)
+					*last = std::string_view(last->data(), last->length() + end - i);
+				else
+					actions.push_back({TEXT_ACTION, 0, 0, 0, std::string_view(buffer + i, end - i)});
+				i = end - 1;
+				continue;
+			}
+
+			if (next != state || c == '\x1B') {
+				vt_exit(decoder, state);
+				vt_entry(decoder, next, c);
+				decoder.state = next;
+			}
+
+			switch (transition >> 4) {
+				case VT_EXECUTE:
+				actions.push_back({CONTROL_ACTION, 0, c});
+				break;
+
+				case VT_COLLECT:
+				seq.collected.push_back(c);
+				break;
+
+				case VT_PARAM:
+				if (seq.ctrl.empty())
+					seq.ctrl.push_back(0);
+				if (c == ';' || c == ':') {
+					if (!seq.ctrl.push_back(0, c == ':'))
+						decoder.state = (state == VT_DCS_PARAM) ? VT_DCS_IGNORE : VT_CSI_IGNORE;
+				} else
+					seq.ctrl.back() = std::min(seq.ctrl.back() * 10 + c - '0', 99999);
+				break;
+
+				case VT_ESC_DISPATCH:
+				// ESC \ is the string terminator; the string itself has already been dispatched
+				if (c == '\\' && seq.collected.empty())
+					break;
+				decoder.esc_type = seq.collected.empty() ? '\x1B' : seq.collected.chars[0];
+				seq.collected.pop_front();
+				vt_dispatch(decoder, ESCAPE_ACTION, c);
+				break;
+
+				case VT_CSI_DISPATCH:
+				vt_dispatch(decoder, ESCAPE_ACTION, c);
+				break;
+
+				case VT_PUT:
+				vt_put(decoder, c);
+				break;
+
+				case VT_OSC_PUT:
+				// OSC Ps ; Pt: the number goes to ctrl, the text to data
+				if (decoder.osc_text) {
+					vt_put(decoder, c);
+				} else if ('0' <= c && c <= '9') {
+					seq.ctrl[0] = std::min(seq.ctrl[0] * 10 + c - '0', 99999);
+				} else {
+					decoder.osc_text = true;
+					if (c != ';') {
+						seq.ctrl[0] = -1;
+						vt_put(decoder, c);
+					}
+				}
+				break;
+			}
+		}
+	}
+
+	void vt_clear(decoder_state& decoder) {
+		decoder.actions.clear();
+		decoder.sequences.clear();
+		// A string still being read moves to the front
+		vt_sequence& seq = decoder.seq;
+		if (decoder.state == VT_OSC_STRING || decoder.state == VT_DCS_PASSTHROUGH) {
+			decoder.strings.erase(0, seq.string_start);
+			seq.string_start = 0;
+		} else {
+			decoder.strings.clear();
+		}
+	}
+
+	std::string vt_describe(const decoder_state& decoder, const parser_action& action) {
+		const vt_sequence& seq = decoder.sequence(action);
+		std::string params = "";
+		for (int i = 0; i < seq.ctrl.size(); i++)
+			params += (i == 0 ? "" : seq.ctrl.is_sub(i) ? ":" : ";") + std::to_string(seq.ctrl[i]);
+
+		switch (action.type) {
+			case OSC_ACTION:
+			return "]" + ((seq.ctrl[0] >= 0) ? std::to_string(seq.ctrl[0]) + ";" : "") + std::string(decoder.string(seq));
+
+			case DCS_ACTION:
+			return "P" + params + action.final + std::string(decoder.string(seq));
+
+			case ESCAPE_ACTION:
+			if (action.esc_type == '[') {
+				// Private markers come before the parameters, intermediate characters after them
+				std::string markers = "", intermediates = "";
+				for (char c : seq.collected.view())
+					((c >= 0x3C) ? markers : intermediates) += c;
+				return "[" + markers + params + intermediates + action.final;
+			}
+			return ((action.esc_type == '\x1B') ? "" : std::string(1, action.esc_type)) + std::string(seq.collected.view()) + action.final;
+		}
+		return "";
+	}
+}
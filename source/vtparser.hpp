@@ -0,0 +1,146 @@
+#ifndef RWM_VTPARSER_H
+#define RWM_VTPARSER_H
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+namespace rwm {
+	enum ACTION_TYPE {
+		TEXT_ACTION,            // Text to print
+		CONTROL_ACTION,         // Control character
+		ESCAPE_ACTION,          // Escape or control sequence
+		OSC_ACTION,             // Operating System Command
+		DCS_ACTION,             // Device Control String
+		NO_ACTION,              // Output found to be overwritten later in the same pass
+	};
+
+	// States of the DEC VT500 parser (see https://vt100.net/emu/dec_ansi_parser)
+	enum VT_STATE {
+		VT_GROUND,
+		VT_ESCAPE,
+		VT_ESCAPE_INTERMEDIATE,
+		VT_CSI_ENTRY,
+		VT_CSI_PARAM,
+		VT_CSI_INTERMEDIATE,
+		VT_CSI_IGNORE,
+		VT_DCS_ENTRY,
+		VT_DCS_PARAM,
+		VT_DCS_INTERMEDIATE,
+		VT_DCS_PASSTHROUGH,
+		VT_DCS_IGNORE,
+		VT_OSC_STRING,
+		VT_SOS_PM_APC_STRING,
+		VT_STATES
+	};
+
+	// What the parser does with a byte on a transition
+	enum VT_ACTION {
+		VT_NONE,
+		VT_PRINT,               // Add to text
+		VT_EXECUTE,             // Control character
+		VT_COLLECT,             // Private marker or intermediate character
+		VT_PARAM,               // Digit or separator of a numerical parameter
+		VT_ESC_DISPATCH,        // Final character of an escape sequence
+		VT_CSI_DISPATCH,        // Final character of a control sequence
+		VT_PUT,                 // Device Control String data
+		VT_OSC_PUT,             // Operating System Command data
+	};
+
+	const int MAX_PARAMS = 32;              // Parameters kept per sequence; sequences with more are ignored
+	const int MAX_COLLECTED = 4;            // Private markers and intermediate characters kept per sequence; more are dropped
+
+	// Numerical parameters of a sequence, stored inline
+	struct vt_params {
+		int values[MAX_PARAMS] = {};
+		uint32_t sub = 0;                  // Bit i is set if parameter i is a sub-parameter (follows ':' instead of ';')
+		int count = 0;
+
+		int size() const { return count; }
+		bool empty() const { return count == 0; }
+		int& operator[](int i) { return values[i]; }
+		int operator[](int i) const { return values[i]; }
+		int& back() { return values[count - 1]; }
+		const int* begin() const { return values; }
+		const int* end() const { return values + count; }
+		bool is_sub(int i) const { return (sub >> i) & 1; }
+		void clear() { count = 0; sub = 0; values[0] = 0; }
+
+		// Returns false if there is no room left
+		bool push_back(int value, bool is_sub = false) {
+			if (count == MAX_PARAMS)
+				return false;
+			values[count] = value;
+			sub |= (uint32_t) is_sub << count;
+			count++;
+			return true;
+		}
+	};
+
+	// Private marker and intermediate characters of a sequence, stored inline
+	struct vt_chars {
+		char chars[MAX_COLLECTED] = {};
+		uint8_t count = 0;
+
+		std::string_view view() const { return std::string_view(chars, count); }
+		bool empty() const { return count == 0; }
+		void clear() { count = 0; }
+		void push_back(char c) { if (count < MAX_COLLECTED) chars[count++] = c; }
+
+		void pop_front() {
+			for (int i = 1; i < count; i++)
+				chars[i - 1] = chars[i];
+			if (count > 0)
+				count--;
+		}
+	};
+
+	// Transitions are packed as (action << 4) | next state
+	extern const std::array<std::array<uint8_t, 256>, VT_STATES> vt_table;
+
+	// What a sequence carries besides its type and final character
+	struct vt_sequence {
+		vt_params ctrl{};                  // Numerical values passed by control sequence
+		vt_chars collected{};              // Private marker and (remaining) intermediate characters
+		uint32_t string_start = 0;         // OSC/DCS string: offset in decoder_state::strings
+		uint32_t string_length = 0;        // OSC/DCS string: length
+	};
+
+	// Piece of process output as split up by the decoder, waiting to be applied to the window
+	struct parser_action {
+		char type = TEXT_ACTION;           // See ACTION_TYPE
+		char esc_type = 0;                 // First intermediate character, '[' for control sequences, '\x1B' if there is none
+		char final = 0;                    // Control character, or character ending the sequence
+		uint32_t seq = 0;                  // Sequences: index in decoder_state::sequences
+		std::string_view text = "";        // Text, pointing into the buffer that was parsed
+	};
+
+	struct decoder_state {
+		int state = VT_GROUND;             // See VT_STATE; sequences may be split across reads
+		bool osc_text = false;             // Past the number of an Operating System Command?
+		char esc_type = 0;                 // Of the sequence being read
+		char final = 0;                    // Of the DCS string being read
+		vt_sequence seq{};                 // Sequence being read
+		std::vector<parser_action> actions = {}; // Decoded output waiting to be applied
+		std::vector<vt_sequence> sequences = {}; // Parameters of the sequences among the actions
+		std::string strings = "";          // OSC/DCS strings of the sequences, and the one being read
+		size_t parsed = 0;                 // Bytes of the window's output buffer the actions were decoded from
+
+		const vt_sequence& sequence(const parser_action& action) const { return sequences[action.seq]; }
+		std::string_view string(const vt_sequence& s) const { return std::string_view(strings).substr(s.string_start, s.string_length); }
+	};
+
+	size_t text_run(const char* buffer, size_t len);         // Length of the text at the start of `buffer`, i.e. up to the first C0 control character or DEL
+	size_t text_run_scalar(const char* buffer, size_t len);  // text_run a byte at a time
+#ifdef __SSE2__
+	size_t text_run_sse2(const char* buffer, size_t len);    // text_run 16 bytes at a time
+	size_t text_run_avx2(const char* buffer, size_t len);    // text_run 32 bytes at a time; only if has_avx2
+	extern const bool has_avx2;                              // Does the CPU have AVX2?
+#endif
+	void vt_parse(decoder_state& decoder, const char* buffer, size_t len);    // Decodes process output into decoder.actions; `buffer` must outlive them
+	void vt_clear(decoder_state& decoder);                                   // Drops the actions once they have been applied, keeping their storage
+	std::string vt_describe(const decoder_state& decoder, const parser_action& action); // Sequence as it was (roughly) received, without ESC; for debug output
+}
+#endif
@@ -9,13 +9,21 @@
 #include <fcntl.h>
 #include <signal.h> 
 #include <sys/wait.h>
+#include <sys/stat.h>
 #include <vector>
 #include <unordered_map>
 #include <limits>
+#include <sstream>
+#include <mutex>
+#include <array>
+#include <algorithm>
 #include "windows.hpp"
 #include "desktop.hpp"
 #include "charencoding.hpp"
 #include "rwm.h"
+#include "events.hpp"
+#include "uring.hpp"
+#include "input.hpp"
 #include <cmath>
 
 namespace rwm {
@@ -29,13 +37,68 @@ namespace rwm {
 	std::unordered_map<int, short> color_map = {};
 	std::unordered_map<uint64_t, chtype> pair_map = {};
 
+	// Windows are applied in parallel (see parse_output), so colors and pairs are numbered under a lock,
+	// and ncurses only learns of them on the main thread (see init_new_colors)
+	std::mutex color_mutex;
+	std::vector<std::array<int, 4>> new_colors = {};           // Index, red, green and blue (0 - 1000) of each color not passed to ncurses yet
+	std::vector<std::array<int, 3>> new_pairs = {};            // Index, foreground and background of each pair not passed to ncurses yet
+
 	std::vector<Window*> windows = {};
 	bool selected_window = false;
+	int jump_scroll = 2;
 	int bold_mode = BOLD;
 
-	char buffer[32768];
 	std::ofstream debug_log(getenv("HOME") + std::string("/.rwmlog"), std::ios::app);
 
+	// Terminal type of programs in windows (see etc/rwm.terminfo)
+	const std::string terminfo_dir = "/tmp/rwm/terminfo";
+	std::string term_name = "";
+	bool private_terminfo = false;          // Entry was compiled into terminfo_dir by RWM itself
+
+	bool has_terminfo(const std::string& dir, const std::string& entry) {
+		char hashed[3];
+		snprintf(hashed, sizeof hashed, "%02x", entry[0]);
+		return access((dir + '/' + entry[0] + '/' + entry).c_str(), R_OK) == 0
+			|| access((dir + '/' + hashed + '/' + entry).c_str(), R_OK) == 0;
+	}
+
+	// RWM's own entry if it is installed (or can be compiled from the config directory), xterm-color otherwise
+	void choose_term() {
+		std::string entry = (COLORS >= 256) ? "rwm-256color" : "rwm";
+		std::vector<std::string> dirs = {getenv("HOME") + std::string("/.terminfo"), "/etc/terminfo", "/lib/terminfo", "/usr/share/terminfo", "/usr/lib/terminfo"};
+		if (getenv("TERMINFO"))
+			dirs.push_back(getenv("TERMINFO"));
+		std::istringstream ss(getenv("TERMINFO_DIRS") ? getenv("TERMINFO_DIRS") : "");
+		for (std::string dir; std::getline(ss, dir, ':');)
+			dirs.push_back(dir);
+		for (const std::string& dir : dirs) {
+			if (!dir.empty() && has_terminfo(dir, entry)) {
+				term_name = entry;
+				return;
+			}
+		}
+
+		const char* config = getenv("RWM_CFG");
+		std::string source = std::string(config ? config : "") + "/rwm.terminfo";
+		if (!has_terminfo(terminfo_dir, entry) && config && access(source.c_str(), R_OK) == 0) {
+			mkdir("/tmp/rwm", 0700);
+			pid_t pid = fork();
+			if (pid == 0) {
+				int null = open("/dev/null", O_WRONLY);
+				dup2(null, 1);
+				dup2(null, 2);
+				sigprocmask(SIG_SETMASK, &default_signals, nullptr);
+				execlp("tic", "tic", "-x", "-o", terminfo_dir.c_str(), source.c_str(), (char*) nullptr);
+				_exit(1);
+			}
+			int exit_status;
+			if (pid > 0)
+				waitpid(pid, &exit_status, 0);
+		}
+		private_terminfo = has_terminfo(terminfo_dir, entry);
+		term_name = private_terminfo ? entry : "xterm-color";
+	}
+
 	void run_child(std::vector<std::string>& args, int master, int slave) {
 		// Source: https://www.rkoucha.fr/tech_corner/pty_pdip.html
 		close(master);
@@ -69,11 +132,14 @@ namespace rwm {
 
 		// Set environment vars
 		if (has_colors())
-			setenv("TERM", "xterm-color", 1);
+			setenv("TERM", term_name.c_str(), 1);
+		if (private_terminfo)
+			setenv("TERMINFO", terminfo_dir.c_str(), 1);
 
 		if (force_convert)
 			setenv("LC_ALL", "C.utf8", 1);
 
+		sigprocmask(SIG_SETMASK, &default_signals, nullptr);
 		execvp(args[0].c_str(), c_args.data());
 
 		exit(0);
@@ -97,6 +163,8 @@ namespace rwm {
 		int flags = fcntl(master, F_GETFL, 0);
 		fcntl(master, F_SETFL, flags | O_NONBLOCK);
 
+		if (term_name.empty())
+			choose_term();
 		pid = fork();
 		if (pid == -1) {
 			// FAIL; needs to be handled properly
@@ -106,6 +174,7 @@ namespace rwm {
 			run_child(args, master, slave);
 		}
 		close(slave);
+		watch(master, this);
 		render(false);
 	}
 
@@ -115,17 +184,12 @@ namespace rwm {
 		ivec2 size_win = {size.y - 2, size.x - 2};
 		frame = newwin(size.y, size.x, pos.y, pos.x);
 		win = derwin(frame, size_win.y, size_win.x, 1, 1);
-		scrollok(win, TRUE);
+		scrollok(win, FALSE);
 		wtimeout(win, 0);
 		idlok(win, TRUE);
 		keypad(win, TRUE);
-
-		alt_frame = newwin(size.y, size.x, pos.y, pos.x);
-		alt_win = derwin(alt_frame, size_win.y, size_win.x, 1, 1);
-		scrollok(alt_win, TRUE);
-		wtimeout(alt_win, 0);
-		idlok(alt_win, TRUE);
-		keypad(alt_win, TRUE);
+		screen.resize(size_win.y, size_win.x);
+		alt_screen.resize(size_win.y, size_win.x);
 
 		title = args[0];
 		status = attrib;
@@ -139,17 +203,12 @@ namespace rwm {
 		this->frame = frame;
 		ivec2 size_win = {size.y - 2, size.x - 2};
 		win = derwin(frame, size_win.y, size_win.x, 1, 1);
-		scrollok(win, TRUE);
+		scrollok(win, FALSE);
 		wtimeout(win, 0);
 		idlok(win, TRUE);
 		keypad(win, TRUE);
-
-		alt_frame = newwin(size.y, size.x, pos.y, pos.x);
-		alt_win = derwin(alt_frame, size_win.y, size_win.x, 1, 1);
-		scrollok(alt_win, TRUE);
-		wtimeout(alt_win, 0);
-		idlok(alt_win, TRUE);
-		keypad(alt_win, TRUE);
+		screen.resize(size_win.y, size_win.x);
+		alt_screen.resize(size_win.y, size_win.x);
 
 		this->title = title;
 
@@ -178,13 +237,42 @@ namespace rwm {
 	}
 
 	void Window::render(bool is_focused) {
-		if (!(status & HIDDEN)) {
-			if (!(status & rwm::FULLSCREEN))
-				rwm_desktop::frame_render(*this, is_focused);
-			curs_set(state.cursor);
-			wnoutrefresh(frame);
-			wnoutrefresh(win);
-			should_refresh = false;
+		if (status & HIDDEN)
+			return;
+		should_refresh = false;
+		clock_gettime(CLOCK_MONOTONIC, &last_render);
+		// Windows covered by other windows are drawn once they are uncovered (see update_layout)
+		if (shown_cells == 0)
+			return;
+		if (!(status & rwm::FULLSCREEN))
+			rwm_desktop::frame_render(*this, is_focused);
+		curs_set((state.flags & SHOW_CURSOR) ? 1 : 0);
+		// During a synchronized update, win keeps what was drawn before it started
+		if (!(status & SYNCHRONIZED))
+			draw();
+		wnoutrefresh(frame);
+		wnoutrefresh(win);
+		if (!partly_shown())
+			return;
+
+		// Where other windows cover it, win still has what it showed before (see draw), so the windows above it are
+		// put on the screen again: the ones over it, and the ones over those (their covered cells are stale as well)
+		static std::vector<WINDOW*> over;
+		over.assign({frame});
+		auto overlaps = [](WINDOW* a, WINDOW* b) {
+			return getbegy(a) < getbegy(b) + getmaxy(b) && getbegy(b) < getbegy(a) + getmaxy(a)
+			    && getbegx(a) < getbegx(b) + getmaxx(b) && getbegx(b) < getbegx(a) + getmaxx(a);
+		};
+		auto it = std::find(windows.begin(), windows.end(), this);
+		for (it = (it == windows.end()) ? it : it + 1; it != windows.end(); it++) {
+			Window* above = *it;
+			if ((above->status & HIDDEN) || std::none_of(over.begin(), over.end(), [&](WINDOW* w) { return overlaps(w, above->frame); }))
+				continue;
+			touchwin(above->frame);
+			wnoutrefresh(above->frame);
+			touchwin(above->win);
+			wnoutrefresh(above->win);
+			over.push_back(above->frame);
 		}
 	}
 
@@ -193,13 +281,12 @@ namespace rwm {
 			kill(pid, SIGHUP);
 		int exit_status;
 		pid_t retval = waitpid(pid, &exit_status, WNOHANG);
+		unwatch(master);
 		if (!retval)
 			status |= ZOMBIE | SHOULD_CLOSE;
 		else { 
 			delwin(win);
 			delwin(frame);
-			delwin(alt_win);
-			delwin(alt_frame);
 			close(master);
 		}
 		return retval;
@@ -211,38 +298,37 @@ namespace rwm {
 		if (status & rwm::FULLSCREEN) {
 			clear_frame();
 			mvwin(frame, 0, 0);
-			mvwin(alt_frame, 0, 0);
 			mvwin(win, 0, 0);
-			mvwin(alt_win, 0, 0);
 			wresize(frame, getmaxy(stdscr), getmaxx(stdscr));
-			wresize(alt_frame, getmaxy(stdscr), getmaxx(stdscr));
 			wresize(win, getmaxy(stdscr) - 1, getmaxx(stdscr) - 1);
-			wresize(alt_win, getmaxy(stdscr) - 1, getmaxx(stdscr) - 1);
 
 		} else if (status & rwm::MAXIMIZED) {
 			clear_frame();
 			mvwin(frame, 0, 0);
-			mvwin(alt_frame, 0, 0);
 			mvwin(win, 1, 1);
-			mvwin(alt_win, 1, 1);
 			wresize(frame, getmaxy(stdscr) - 1, getmaxx(stdscr));
-			wresize(alt_frame, getmaxy(stdscr) - 1, getmaxx(stdscr));
 			wresize(win, getmaxy(stdscr) - 3, getmaxx(stdscr) - 2);
-			wresize(alt_win, getmaxy(stdscr) - 3, getmaxx(stdscr) - 2);
 
 		} else {
 			clear_frame();
 			wresize(frame, size.y, size.x);
-			wresize(alt_frame, size.y, size.x);
 			wresize(win, size.y - 2, size.x - 2);
-			wresize(alt_win, size.y - 2, size.x - 2);
 			mvwin(frame, pos.y, pos.x);
-			mvwin(alt_frame, pos.y, pos.x);
 			mvwin(win, pos.y + 1, pos.x + 1);
-			mvwin(alt_win, pos.y + 1, pos.x + 1);
+		}
+		fit_screen();
+	}
+
+	void Window::fit_screen() {
+		int height = getmaxy(win), width = getmaxx(win);
+		if (height != screen.height || width != screen.width) {
+			// After a resize, the process redraws everything anyway
+			synchronize(false);
+			screen.resize(height, width);
+			alt_screen.resize(height, width);
 		}
 		winsize wsize;
-		rwm::ivec2 size_win = {getmaxy(win), getmaxx(win)};
+		rwm::ivec2 size_win = {height, width};
 		if (ioctl(0, TIOCGWINSZ, (char *) &wsize) < 0)
 			print_debug("TIOCGWINSZ error");
 		wsize.ws_xpixel = (wsize.ws_xpixel / wsize.ws_col) * size_win.x;
@@ -251,11 +337,11 @@ namespace rwm {
 		wsize.ws_col = size_win.x;
 		ioctl(master, TIOCSWINSZ, (char *) &wsize);
 		should_refresh = true;
+		invalidate_layout();
 	}
 
 	void Window::clear_frame() {
 		wborder(frame, ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ');
-		wborder(alt_frame, ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ');
 	}
 
 	void Window::resize(ivec2 size) {
@@ -265,19 +351,8 @@ namespace rwm {
 		this->size = size;
 		clear_frame();
 		wresize(frame, size.y, size.x);
-		wresize(alt_frame, size.y, size.x);
 		wresize(win, size.y - 2, size.x - 2);
-		wresize(alt_win, size.y - 2, size.x - 2);
-		winsize wsize;
-		rwm::ivec2 size_win = {getmaxy(win), getmaxx(win)};
-		if (ioctl(0, TIOCGWINSZ, (char *) &wsize) < 0)
-			print_debug("TIOCGWINSZ error");
-		wsize.ws_xpixel = (wsize.ws_xpixel / wsize.ws_col) * size_win.x;
-		wsize.ws_ypixel = (wsize.ws_ypixel / wsize.ws_row) * size_win.y;
-		wsize.ws_row = size_win.y;
-		wsize.ws_col = size_win.x;
-		ioctl(master, TIOCSWINSZ, (char *) &wsize);
-		should_refresh = true;
+		fit_screen();
 	}
 
 
@@ -293,7 +368,7 @@ namespace rwm {
 		{21, A_UNDERLINE}
 	};
 	std::unordered_map<int, chtype> attr_modes_off = {
-		{22, A_DIM},
+		{22, A_BOLD | A_DIM},
 		{23, A_ITALIC},
 		{24, A_UNDERLINE},
 		{25, A_BLINK},
@@ -383,7 +458,60 @@ namespace rwm {
 		return closest;
 	}
 
+	void init_colors() {
+		if (!has_colors())
+			return;
+		start_color();
+		use_default_colors();
+		assume_default_colors((uint32_t) DEFAULT_COLOR, (uint32_t) (DEFAULT_COLOR >> 32));
+		
+		// Initialise bright colors
+		base_colors = (COLORS < base_colors) ? COLORS : base_colors;
+		max_colors = (COLORS < max_colors) ? COLORS : max_colors;
+		max_color_pairs = (COLOR_PAIRS < max_color_pairs) ? COLOR_PAIRS : max_color_pairs;
+		if (!HAS_EXT_COLOR) {
+			max_colors = (256 < max_colors) ? 256 : max_colors;
+			max_color_pairs = (256 < max_color_pairs) ? 256 : max_color_pairs;
+		}
+
+		for (short i = 8; i < base_colors; i++) {
+			init_color(i, (i & 1) ? 1000 : 500, (i & 2) ? 1000 : 500, (i & 4) ? 1000 : 500);
+		}
+		colors = base_colors;
+
+		for (int i = -1; i < colors; i++) {
+			color_map.insert_or_assign(i, i);
+		}
+
+		if (colors < 16) {
+			for (int i = colors; i < 16; i++) {
+				color_map.insert_or_assign(i, i - colors);
+			}
+		}
+
+		pair_map.insert_or_assign(DEFAULT_COLOR, COLOR_PAIR(0));
+	}
+
+	void init_new_colors() {
+		std::lock_guard<std::mutex> lock(color_mutex);
+		for (auto [i, red, green, blue] : new_colors) {
+			if (HAS_EXT_COLOR)
+				init_extended_color(i, red, green, blue);
+			else
+				init_color(i, red, green, blue);
+		}
+		for (auto [i, fg, bg] : new_pairs) {
+			if (HAS_EXT_COLOR)
+				init_extended_pair(i, fg, bg);
+			else
+				init_pair(i, fg, bg);
+		}
+		new_colors.clear();
+		new_pairs.clear();
+	}
+
 	void Window::apply_color(int c, bool bg) {
+		std::unique_lock<std::mutex> lock(color_mutex);
 		auto color_it = color_map.find(c);
 		if (color_it == color_map.end()) {
 			int red = (c >> 16) & 0xff;
@@ -409,10 +537,7 @@ namespace rwm {
 				}
 			}
 			if (can_change_color() && colors < max_colors) {
-				if (HAS_EXT_COLOR)
-					init_extended_color(colors, red * 1000 / 255, green * 1000 / 255, blue * 1000 / 255);
-				else
-					init_color(colors, red * 1000 / 255, green * 1000 / 255, blue * 1000 / 255);
+				new_colors.push_back({colors, red * 1000 / 255, green * 1000 / 255, blue * 1000 / 255});
 				color_map.insert_or_assign(c, colors);
 				colors++;
 			} else {
@@ -420,6 +545,7 @@ namespace rwm {
 			}
 		}
 	found:
+		lock.unlock();
 		if (base_colors < 16 && c < 16) {
 			if (c >= base_colors) {
 				if ((bg && bold_mode == BRIGHT_BG) || (!bg && bold_mode == BRIGHT_FG)) {
@@ -438,7 +564,7 @@ namespace rwm {
 		if (bg) {
 			state.color = (((uint64_t) c) << 32) | (state.color & 0xffffffff);
 		} else {
-			state.color = (state.color & 0xffffffff00000000) | c;
+			state.color = (state.color & 0xffffffff00000000) | (uint32_t) c;
 		}
 	}
 
@@ -522,17 +648,18 @@ namespace rwm {
 	}
 
 	void Window::apply_color_pair() {
+		// Only looked up again once the colors change
+		if (state.color == state.pair_color)
+			return;
 		int fc = state.color & 0xffffffff;
 		int bc = state.color >> 32;
 		uint64_t pair = state.color;
 
+		std::lock_guard<std::mutex> lock(color_mutex);
 		auto pair_it = pair_map.find(pair);
 		if (pair_it == pair_map.end()) {
 			if (color_pairs < max_color_pairs) {
-				if (HAS_EXT_COLOR) 
-					init_extended_pair(color_pairs, color_map.at(fc), color_map.at(bc));
-				else 
-					init_pair(color_pairs, color_map.at(fc), color_map.at(bc));
+				new_pairs.push_back({color_pairs, color_map.at(fc), color_map.at(bc)});
 				pair_map.insert_or_assign(pair, color_pairs);
 				color_pairs++;
 			} else {
@@ -540,6 +667,7 @@ namespace rwm {
 			}
 		}
 		state.color_pair = pair_map.at(pair);
+		state.pair_color = state.color;
 	}
 
 	// WINDOW ATTRIBUTES
@@ -551,7 +679,28 @@ namespace rwm {
 			state.attrib = 0;
 			state.color = DEFAULT_COLOR;
 		}
-		for (int c : state.ctrl) {
+		for (int i = 0; i < state.ctrl.size(); i++) {
+			int c = state.ctrl[i];
+			// Sub-parameters (colon form) belong to the parameter before them
+			int subs = 0;
+			while (i + subs + 1 < state.ctrl.size() && state.ctrl.is_sub(i + subs + 1))
+				subs++;
+			if (subs > 0 && !custom_color_mode) {
+				const int* sub = &state.ctrl[i + 1];
+				i += subs;
+				if ((c == 38 || c == 48) && sub[0] == 5 && subs >= 2) {
+					apply_color((sub[1] & 0xFF) | 0x01000000, c == 48);
+				} else if ((c == 38 || c == 48) && sub[0] == 2 && subs >= 4) {
+					// 38:2:r:g:b, or 38:2:colorspace:r:g:b
+					apply_color(((sub[subs - 3] & 0xFF) << 16) | ((sub[subs - 2] & 0xFF) << 8) | (sub[subs - 1] & 0xFF) | 0x02000000, c == 48);
+				} else if (c == 4 && sub[0] == 0) {
+					state.attrib &= ~A_UNDERLINE;
+				} else if (c == 4) {
+					state.attrib |= A_UNDERLINE;
+				}
+				continue;
+			}
+
 			if (custom_color_mode) {
 				switch (custom_color_mode % 10) {
 				case 0:
@@ -621,10 +770,6 @@ namespace rwm {
 			break;
 			}
 		}
-		if (HAS_EXT_COLOR)
-			wattrset(win, state.attrib | COLOR_PAIR(state.color_pair));
-		else
-			wattr_set(win, state.attrib, state.color_pair, nullptr);
 	}
 
 	void Window::do_osc() {
@@ -632,18 +777,27 @@ namespace rwm {
 		if (state.ctrl[0] == 0 || state.ctrl[0] == 2) {
 			title = state.out;
 		} else if (state.ctrl[0] == 50) {
-			ret = spawn({"/bin/setfont", state.out});
+			ret = spawn({"/bin/setfont", std::string(state.out)});
 		} else if (state.ctrl[0] == 112) {
 			state.color = DEFAULT_COLOR;
+		} else if (state.ctrl[0] == 7701) {
+			// RWM-specific: set refresh rates (focused;visible;occluded), empty = use global setting
+			std::istringstream ss{std::string(state.out)};
+			std::string rate;
+			for (int i = 0; i < 3 && std::getline(ss, rate, ';'); i++)
+				refresh_rate[i] = rate.empty() ? -1 : atoi(rate.c_str());
+		} else if (state.ctrl[0] == 7702) {
+			// RWM-specific: set jump scroll threshold (in window heights), empty = use global setting
+			jump_scroll = state.out.empty() ? -1 : atoi(std::string(state.out).c_str());
 		} else if (DEBUG)
-			print_debug(state.esc_seq);
+			print_debug(vt_describe(decoder, *state.action));
 	}
 
 	void Window::do_dcs() {
 		//char error_msg[] = "\033P0$r\033\\";
 		//write(windows[SEL_WIN]->master, error_msg, sizeof(error_msg) - 1);
 		if (DEBUG)
-			print_debug(state.esc_seq);
+			print_debug(vt_describe(decoder, *state.action));
 	}	
 
 	void Window::do_private_seq(char mode) {
@@ -655,11 +809,11 @@ namespace rwm {
 			break;
 
 			case 7:
-			state.line_wrap = (mode == 'h');
+			state.flags = (mode == 'h') ? (state.flags | LINE_WRAP) : (state.flags & ~LINE_WRAP);
 			break;
 
 			case 25:
-			state.cursor = (mode == 'h') ? 1 : (mode == 'l') ? 0 : state.cursor;
+			state.flags = (mode == 'h') ? (state.flags | SHOW_CURSOR) : (state.flags & ~SHOW_CURSOR);
 			break;
 
 			case 1000: case 1005: case 1006: case 1015: case 1016:
@@ -671,102 +825,134 @@ namespace rwm {
 			break;
 
 			case 1048: 
-			if (mode == 'h') {
-				int x, y;
-				getyx(win, y, x);
-				state.saved_cursor_pos = {y, x};
-			} else if (mode == 'l') {
-				wmove(win, state.saved_cursor_pos.y, state.saved_cursor_pos.x);
-			}
+			if (mode == 'h')
+				state.saved_cursor_pos = {screen.y, screen.x};
+			else if (mode == 'l')
+				screen.move(state.saved_cursor_pos.y, state.saved_cursor_pos.x);
 			break;
 
 			case 47:
 			case 1049:
 			case 1047:
 			if ((mode == 'h' && alt_win_no == 0) || (mode == 'l' && alt_win_no == 1)) {
-				WINDOW* frame_temp = frame;
-				WINDOW* win_temp = win;
-				frame = alt_frame;
-				win = alt_win;
-				alt_frame = frame_temp;
-				alt_win = win_temp;
+				if (!single_buffer) {
+					std::swap(screen, alt_screen);
+					screen.touch_all();
+				}
 				alt_win_no ^= 1;
 			}
 			break;
 
+			case 2004:
+			status = (status | ((mode == 'h') ? BRACKETED_PASTE : 0)) & ~((mode == 'l') ? BRACKETED_PASTE : 0);
+			break;
+
+			case 2026:
+			synchronize(mode == 'h');
+			break;
+
 			default:
 			if (DEBUG)
-				print_debug(state.esc_seq);
+				print_debug(vt_describe(decoder, *state.action));
 			break;
+		}
+	}
 
-			//case 2004:		// TODO
+	void Window::report_mode(bool dec) {
+		int n1 = (state.ctrl.size() > 0) ? state.ctrl[0] : 0;
+		int mode_state = 0; // 0 = not recognised, 1 = set, 2 = reset
+		if (dec) {
+			switch (n1) {
+				case 1: mode_state = (status & APP_CURSOR) ? 1 : 2; break;
+				case 7: mode_state = (state.flags & LINE_WRAP) ? 1 : 2; break;
+				case 25: mode_state = (state.flags & SHOW_CURSOR) ? 1 : 2; break;
+				case 47: case 1047: case 1049: mode_state = alt_win_no ? 1 : 2; break;
+				case 1000: case 1005: case 1006: case 1015: case 1016: mode_state = (mouse_mode == n1) ? 1 : 2; break;
+				case 1004: mode_state = (status & REPORT_FOCUS) ? 1 : 2; break;
+				case 2004: mode_state = (status & BRACKETED_PASTE) ? 1 : 2; break;
+				case 2026: mode_state = (status & SYNCHRONIZED) ? 1 : 2; break;
+			}
+		} else if (n1 == 4) {
+			mode_state = (status & INSERT) ? 1 : 2;
+		} else if (n1 == 20) {
+			mode_state = (state.flags & AUTO_NEWLINE) ? 1 : 2;
+		}
+		send(std::string(dec ? "\033[?" : "\033[") + std::to_string(n1) + ';' + std::to_string(mode_state) + "$y");
+	}
 
+	void Window::synchronize(bool on) {
+		if (on == (bool) (status & SYNCHRONIZED))
+			return;
+		if (!on) {
+			status &= ~SYNCHRONIZED;
+			should_refresh = true;
+			return;
 		}
+
+		// win keeps what is on the screen now until the update ends, so the window never shows it half-drawn
+		draw();
+		clock_gettime(CLOCK_MONOTONIC, &sync_start);
+		status |= SYNCHRONIZED;
 	}
 
 	void Window::move_cursor(char mode) {
 		int x, y, n1, n2;
-		getyx(win, y, x);
+		y = screen.y;
+		x = screen.x;
 		n1 = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 1) : 1;
 		n2 = (state.ctrl.size() > 1) ? std::max(state.ctrl[1], 1) : 1;
 		//this->should_refresh = true;
+		// Like in other terminals, the cursor stops at the edges
 		switch (mode) {
 			case 'A':
-			wmove(win, y - n1, x);
+			screen.move(y - n1, x);
 			break;
 			case 'B': case 'e':
-			wmove(win, y + n1, x);
+			screen.move(y + n1, x);
 			break;
 			case 'C': case 'a':
-			wmove(win, y, x + n1);
+			screen.move(y, x + n1);
 			break;
 			case 'D':
-			wmove(win, y, x - n1);
+			screen.move(y, x - n1);
 			break;
 			case 'E':
-			wmove(win, y + n1, 0);
+			screen.move(y + n1, 0);
 			break;
 			case 'F':
-			wmove(win, y - n1, 0);
+			screen.move(y - n1, 0);
 			break;
 			case 'G': case '`':
-			wmove(win, y, n1 - 1);
+			screen.move(y, n1 - 1);
 			break;
 			case 'H': case 'f':
-			wmove(win, n1 - 1, n2 - 1);
+			screen.move(n1 - 1, n2 - 1);
 			break;
 			case 'I': case 'Z': {
-				for (int i = 0; i < state.tabstop.size(); i++) {
-					if (state.tabstop[i] > x || i == state.tabstop.size() - 1) {
-						int p;
-						if (mode == 'I')
-							p = std::min((int)state.tabstop.size() - 1, i + n1);
-						else
-							p = std::max(0, i - n1);
-						wmove(win, y, state.tabstop[p]);
+				// Stops at the last tab stop there is
+				int p = x;
+				for (int i = 0; i < n1; i++) {
+					int next = (mode == 'I') ? state.tabstop.next(p) : state.tabstop.prev(p);
+					if (next < 0)
 						break;
-					}
+					p = next;
 				}
+				screen.move(y, p);
 			}
 			break;
 			case 'd':
-			wmove(win, n1 - 1, x);
+			screen.move(n1 - 1, x);
 			break;
 
-			case 'S':
-			wscrl(win, n1);
-			break;
-
-			case '^':
-			case 'T':
-			wscrl(win, -n1);
+			case 'S': case '^': case 'T':
+			scroll_lines(screen.top, screen.bot, (mode == 'S') ? n1 : -n1);
 			break;
 
 			case 's':
 			state.saved_cursor_pos = {y, x};
 			break;
 			case 'u':
-			wmove(win, state.saved_cursor_pos.y, state.saved_cursor_pos.x);
+			screen.move(state.saved_cursor_pos.y, state.saved_cursor_pos.x);
 			break;
 
 			case 'n':
@@ -789,10 +975,7 @@ namespace rwm {
 	}
 
 	void Window::flatten_buffers() {
-		delwin(alt_win);
-		delwin(alt_frame);
-		alt_win = win;
-		alt_frame = frame;
+		single_buffer = true;
 	}
 
 	void Window::move_by(ivec2 d) {
@@ -808,43 +991,29 @@ namespace rwm {
 		if (can_move == ERR)
 			return;
 		this->pos = pos;
-		mvwin(alt_frame, pos.y, pos.x);
 
 		mvwin(win, pos.y + offset.y, pos.x + offset.x);
-		mvwin(alt_win, pos.y + offset.y, pos.x + offset.x);
+		invalidate_layout();
 	}
 
 	void Window::add_tabstop() {
-		int x, y;
-		getyx(win, y, x);
-		for (int i = 0; i < state.tabstop.size(); i++) {
-			if (x < state.tabstop[i]) {
-				state.tabstop.insert(state.tabstop.begin() + i, x);
-				return;
-			}
-		}
-		state.tabstop.push_back(x);
+		state.tabstop.set(screen.x);
 	}
 
 	void Window::remove_tabstop() {
-		int x, y;
-		getyx(win, y, x);
-		for (int i = 0; i < state.tabstop.size(); i++) {
-			if (x == state.tabstop[i]) {
-				state.tabstop.erase(state.tabstop.begin() + i);
-				return;
-			}
-		}
+		state.tabstop.reset(screen.x);
 	}
 
 	void Window::manipulate_window() {
 		switch(state.ctrl[0]) {
 		case 1:
 			status &= ~rwm::HIDDEN;
+			invalidate_layout();
 			break;
 
 		case 2:
 			status |= rwm::HIDDEN;
+			invalidate_layout();
 			if (SEL_WIN >= 0 && this == rwm::windows[SEL_WIN]) {
 				rwm::selected_window = false;
 				curs_set(0);
@@ -899,7 +1068,7 @@ namespace rwm {
 			break;
 
 		case 18: 
-			send("\033[8;" + std::to_string(getmaxy(win)) + ';' + std::to_string(getmaxx(win)) + 't');
+			send("\033[8;" + std::to_string(screen.height) + ';' + std::to_string(screen.width) + 't');
 			break;
 
 		case 19: 
@@ -912,7 +1081,7 @@ namespace rwm {
 			
 		default:
 			if (DEBUG)
-				print_debug(state.esc_seq);
+				print_debug(vt_describe(decoder, *state.action));
 			return;
 		}
 		should_refresh = true;
@@ -920,14 +1089,17 @@ namespace rwm {
 
 	void Window::erase(char mode) {
 		int n1 = (state.ctrl.size() > 0) ? state.ctrl[0] : 0;
+		int y = screen.y, x = screen.x;
 		switch (mode) {
 			case 'J':
 			switch(n1) {
 				case 0:
-				wclrtobot(win);
+				screen.fill(y, x, screen.width, cell{});
+				for (int i = y + 1; i < screen.height; i++)
+					screen.fill(i, 0, screen.width, cell{});
 				break;
 				case 2:
-				wclear(win);
+				screen.clear();
 				break;
 			}
 			break;
@@ -935,103 +1107,217 @@ namespace rwm {
 			case 'K':
 			switch(n1) {
 				case 0:
-				wclrtoeol(win);
+				screen.fill(y, x, screen.width, cell{});
 				break;
-				case 2: {
-					int x, y;
-					getyx(win, y, x);
-					wmove(win, y, 0);
-					wclrtoeol(win);
-					wmove(win, y, x);
-				}
+				case 2:
+				screen.fill(y, 0, screen.width, cell{});
 				break;
 			}
 			break;
 
 
-			// hacky solution to respect scrolling regions, which ncurses refuses to do
-			case 'L':{
-				flush();
-				int x, y, top, bot;
-				getyx(win, y, x);
-				wgetscrreg(win, &top, &bot);
-				wsetscrreg(win, y, bot);
-				wscrl(win, -std::max(n1, 1));
-				wmove(win, y, 0);
-				wsetscrreg(win, top, bot);
-			}
+			// Lines are inserted and deleted within the scrolling region
+			case 'L': case 'M':
+			if (y < screen.top || y > screen.bot)
+				break;
+			scroll_lines(y, screen.bot, (mode == 'M') ? std::max(n1, 1) : -std::max(n1, 1));
+			screen.move(y, 0);
 			break;
 
-			case 'M': {
-				flush();
-				int x, y, top, bot;
-				getyx(win, y, x);
-				wgetscrreg(win, &top, &bot);
-				wsetscrreg(win, y, bot);
-				wscrl(win, std::max(n1, 1));
-				wmove(win, y, 0);
-				wsetscrreg(win, top, bot);
-			}
+			case '@':
+			shift_row(std::max(n1, 1));
 			break;
 
 			case 'P':
-			flush();
-			for (int i = 0; i < n1; i++)
-				wdelch(win);
+			shift_row(-std::max(n1, 1));
 			break;
 
-			case 'X': {
-				int x, y;
-				getyx(win, y, x);
-				state.out += std::string(n1, ' ');
-				flush();
-				wmove(win, y, x);
-			}
+			// Erased characters take the current attributes
+			case 'X':
+			flush();
+			screen.fill(y, x, x + std::max(n1, 1), cell{' ', 0, (uint32_t) state.attrib, state.color_pair});
+			state.flags &= ~WRAP_PENDING;
 			break;
 		}
 	}
 
-	void Window::flush() {
-		int x, y;
-		getyx(win, y, x);
+	void Window::shift_row(int n) {
+		screen.shift(screen.y, screen.x, n, cell{});
+	}
+
+	void Window::flush(std::string_view text) {
 		apply_color_pair();
-		if (HAS_EXT_COLOR)
-			wattr_set(win, state.attrib, state.color_pair, nullptr);
-		else
-			wattrset(win, state.attrib | COLOR_PAIR(state.color_pair));
+		if (text.empty())
+			return;
+		if (DEBUG)
+			debug_log << text << '\n';
+
+		// With the VT220 graphics set, '`' to '~' are taken from the line drawing characters
+		cell c{' ', 0, (uint32_t) state.attrib, state.color_pair};
+		bool graphics = state.flags & VT220_GRAPHICS;
+		auto next_char = [&](size_t i, size_t& len, int& w) {
+			unsigned char b = text[i];
+			c.attr = state.attrib;
+			if (b >= 0x80) {
+				c.ch = utf8_char(text, i, len, w);
+				return;
+			}
+			len = 1;
+			w = 1;
+			c.ch = b;
+			chtype acs = (graphics && b >= '`' && b <= '~') ? NCURSES_ACS(b) : 0;
+			if (acs & A_CHARTEXT) {
+				c.ch = acs & A_CHARTEXT;
+				c.attr |= acs & A_ATTRIBUTES;
+			}
+		};
+
+		int width = screen.width, y = screen.y, x = screen.x, w;
+		size_t len;
 		if (status & INSERT) {
-			winsstr(win, state.out.c_str());
-			wmove(win, y, x + utf8length(state.out));
+			int cols = 0;
+			for (size_t i = 0; i < text.length(); i += len)
+				cols += utf8_char_width(text, i, len);
+			screen.shift(y, x, cols, cell{});
+			for (size_t i = 0; i < text.length() && x < width; i += len) {
+				next_char(i, len, w);
+				if (x + w > width)
+					break;
+				screen.put(y, x, c, w);
+				x += w;
+			}
+			screen.touch(y);
+			screen.move(y, screen.x + cols);
 			return;
 		}
 
-		// Complicated scrolling code to override default ncurses scrolling behaviour
-		scrollok(win, FALSE);
-		int maxlen;
-		if (state.line_wrap)
-			maxlen = getmaxx(win) - x + ((getmaxy(win) - y - 1) * (getmaxx(win) - 1));
-		else
-			maxlen = getmaxx(win) - x + 1;
-		waddstr_enc(win, utf8substr(state.out, 0, maxlen));
-		if (DEBUG)
-			debug_log << utf8substr(state.out, 0, maxlen) << '\n';
-
-		if (state.line_wrap) {
-			for (int i = maxlen; i < utf8length(state.out); i += getmaxx(win) - 1) {
-				scrollok(win, TRUE);
-				scroll(win);
-				wmove(win, y, 0);
-				scrollok(win, FALSE);
-				waddstr_enc(win, utf8substr(state.out, i, i + getmaxx(win) - 2));
-				if (DEBUG)
-					debug_log << utf8substr(state.out, i, i + getmaxx(win) - 2) << '\n';
+		// Text is drawn one row at a time; like in xterm, a row that is filled up only wraps when more text follows
+		size_t start = 0;
+		while (start < text.length()) {
+			if (state.flags & WRAP_PENDING) {
+				state.flags &= ~WRAP_PENDING;
+				if (y == screen.bot)
+					scroll_lines(screen.top, screen.bot, 1);
+				else if (y < screen.height - 1)
+					y++;
+				x = 0;
+			}
+
+			// Up to the end of the row
+			size_t end = start;
+			int col = x;
+			while (end < text.length()) {
+				next_char(end, len, w);
+				if (col + w > width)
+					break;
+				screen.put(y, col, c, w);
+				col += w;
+				end += len;
+			}
+			if (end == start && x == 0) {
+				// Character wider than the window; not drawn
+				utf8_char_width(text, end, len);
+				end += len;
+			}
+			screen.touch(y);
+			start = end;
+			if (col < width && start == text.length()) {
+				x = col;
+				break;
+			}
+
+			// Right margin reached
+			if (!(state.flags & LINE_WRAP) && start < text.length()) {
+				// The rest of the text overwrites the last column, so only its last character stays
+				size_t last = text.length() - 1;
+				while (last > start && (text[last] & 0xc0) == 0x80)
+					last--;
+				next_char(last, len, w);
+				screen.put(y, std::max(width - w, 0), c, w);
+				start = text.length();
+			}
+			x = width - 1;
+			if (state.flags & LINE_WRAP)
+				state.flags |= WRAP_PENDING;
+		}
+		screen.move(y, x);
+	}
+
+	void Window::scroll_lines(int top, int bot, int n) {
+		screen.scroll_rows(top, bot, n);
+	}
+
+	bool Window::partly_shown() {
+		return shown_cells > 0 && shown_cells < getmaxy(frame) * getmaxx(frame);
+	}
+
+	void Window::draw() {
+		// Cells bring their own attributes; the ones of the window would be added to them
+		wattr_set(win, A_NORMAL, 0, nullptr);
+		bool partly = partly_shown();
+		int begy, begx;
+		getbegyx(win, begy, begx);
+		for (int y = 0; y < screen.height; y++) {
+			if (!screen.is_dirty(y))
+				continue;
+			if (!partly) {
+				draw_span(y, 0, screen.width);
+				continue;
+			}
+			// Covered parts are left out; update_layout has them drawn once they are uncovered
+			for (int from = 0, to; from < screen.width; from = to) {
+				bool shown = is_shown(this, {begy + y, begx + from});
+				for (to = from + 1; to < screen.width && is_shown(this, {begy + y, begx + to}) == shown; to++);
+				if (shown)
+					draw_span(y, from, to);
+			}
+		}
+		screen.clean();
+		wmove(win, screen.y, screen.x);
+	}
+
+	void Window::draw_span(int y, int from, int to) {
+		static std::vector<cchar_t> line;
+		static std::string text;
+		const cell* row = screen.row(y);
+		// The right half of a wide character is drawn with its left half
+		if (from > 0 && row[from].ch == 0)
+			from--;
+		if (utf8 && !is_tty && !force_convert) {
+			// The span is copied in one go; the right halves of wide characters are not passed
+			line.resize(to - from);
+			int n = 0;
+			for (int x = from; x < to; x++) {
+				if (row[x].ch == 0)
+					continue;
+				wchar_t wch[3] = {(wchar_t) row[x].ch, (wchar_t) row[x].comb, 0};
+				int pair = row[x].pair;
+				setcchar(&line[n++], wch, row[x].attr, HAS_EXT_COLOR ? 0 : pair, HAS_EXT_COLOR ? &pair : nullptr);
 			}
-		} else if (maxlen <= utf8length(state.out)) {
-			wmove(win, y, getmaxx(win) - 1);
+			mvwadd_wchnstr(win, y, from, line.data(), n);
+			return;
 		}
 
-		scrollok(win, TRUE);
-		state.out = "";
+		// Characters may need to be converted; runs of the same attributes are drawn as text
+		wmove(win, y, from);
+		for (int x = from; x < to;) {
+			uint32_t attr = row[x].attr;
+			int pair = row[x].pair;
+			text.clear();
+			for (; x < to && row[x].attr == attr && row[x].pair == pair; x++) {
+				if (row[x].ch == 0)
+					continue;
+				utf8_append(text, row[x].ch);
+				if (row[x].comb)
+					utf8_append(text, row[x].comb);
+			}
+			if (HAS_EXT_COLOR)
+				wattr_set(win, attr, 0, &pair);
+			else
+				wattrset(win, attr | COLOR_PAIR(pair));
+			waddstr_enc(win, text);
+		}
+		wattr_set(win, A_NORMAL, 0, nullptr);
 	}
 
 	void print_debug(std::string msg) {
@@ -1050,319 +1336,549 @@ namespace rwm {
 		debug_log << msg << '\n';
 	}
 
+	// Input for a process that is not reading it is dropped once max_send_queue is waiting, so the terminal
+	// (and with it RWM's key bindings) is still read and the queue cannot grow without bounds
 	void Window::send(std::string message) {
-		if (!(status & ZOMBIE))
-			write(master, message.c_str(), message.size());
+		if (can_send())
+			send_queue += message;
 	}
 
 	void Window::send(char c) {
-		if (c == '\r' && state.auto_nl) 
-			send("\r\n");
-		else if (!(status & ZOMBIE))
-			write(master, &c, 1);
+		if (!can_send())
+			return;
+		if (c == '\r' && (state.flags & AUTO_NEWLINE)) 
+			send_queue += "\r\n";
+		else
+			send_queue += c;
 	}
 
-	int Window::output() {
-		int ret = sizeof buffer;
+	// Once part of a paste is dropped, the rest of it is too, so the process never gets a paste with a gap in it
+	void Window::paste(const std::string& text, int flags) {
+		if (flags & PASTE_START)
+			paste_dropped = false;
+		if ((flags & PASTE_START) && (status & BRACKETED_PASTE))
+			send_queue += "\033[200~";
+		if (!paste_dropped && !can_send()) {
+			paste_dropped = true;
+			beep();
+		}
+		if (!paste_dropped)
+			send_queue += text;
+		if ((flags & PASTE_END) && (status & BRACKETED_PASTE))
+			send_queue += "\033[201~";
+	}
+
+	bool Window::can_send() {
+		return send_queue.length() - sent < max_send_queue;
+	}
+
+	void Window::flush_input() {
+		if (sent == send_queue.length())
+			return;
+		while (sent < send_queue.length() && !(status & ZOMBIE)) {
+			int ret = write(master, send_queue.data() + sent, send_queue.length() - sent);
+			if (ret > 0)
+				sent += ret;
+			else if (ret == -1 && errno == EINTR)
+				continue;
+			else if (ret == -1 && errno == EAGAIN)
+				break;
+			else
+				sent = send_queue.length();
+		}
+
+		if (sent == send_queue.length() || (status & ZOMBIE)) {
+			send_queue.clear();
+			sent = 0;
+			if (waiting_to_send)
+				watch_output(master, this, false);
+			waiting_to_send = false;
+		} else {
+			// The process is not reading its input; the rest is written once the master becomes writable
+			if (sent >= 65536) {
+				send_queue.erase(0, sent);
+				sent = 0;
+			}
+			if (!waiting_to_send)
+				watch_output(master, this, true);
+			waiting_to_send = true;
+		}
+	}
+
+	int Window::fill_buffer() {
+		for (int i = 0; i < 2; i++) {
+			size_t len;
+			char* area = output_buffer.write_area(len);
+			if (len == 0)
+				return READ_FULL;
+
+			int ret = read(master, area, len);
+			if (ret > 0) {
+				output_buffer.commit(ret);
+				if ((size_t) ret < len)
+					return READ_AGAIN;
+			} else if (ret == 0 || (errno != EAGAIN && errno != EINTR)) {
+				return READ_HUP;
+			} else {
+				return READ_AGAIN;
+			}
+		}
+		return READ_AGAIN;
+	}
+
+	void Window::receive() {
+		readable = false;
+		if (reader == URING_READER) {
+			switch (uring_receive(this, output_buffer)) {
+				case READ_FULL:
+				readable = true;
+				break;
+
+				case READ_HUP:
+				// Only closed once all output has been parsed
+				if (pending() > 0) {
+					readable = true;
+				} else if (!(status & SHOULD_CLOSE)) {
+					status |= SHOULD_CLOSE;
+					unwatch(master);
+				}
+				break;
+			}
+			return;
+		} else if (reader == THREAD_READER) {
+			// Output read by the reader thread is only closed once it has all been parsed
+			if (hung_up && pending() == 0 && !(status & SHOULD_CLOSE)) {
+				status |= SHOULD_CLOSE;
+				unwatch(master);
+			} else if (reader_paused.exchange(false)) {
+				resume_reading(master);
+			}
+			return;
+		}
+
+		switch (fill_buffer()) {
+			case READ_FULL:
+			// Read the rest once the scheduler has caught up
+			readable = true;
+			break;
+
+			case READ_HUP:
+			// Stop watching the master, as the hang-up would be reported forever
+			status |= SHOULD_CLOSE;
+			unwatch(master);
+			break;
+		}
+	}
+
+	size_t Window::pending() {
+		return output_buffer.size() - decoder.parsed;
+	}
+
+	int Window::output(size_t budget) {
 		int should_refresh = this->should_refresh;
 		this->should_refresh = false;
 		if (status & ZOMBIE)
 			return 1;
-		for (int i = 0; i < ret; i++) {
-			if (i == 0) {
-				pollfd p{master, POLLHUP, 1};
-				poll(&p, 1, 1);
-				if ((p.revents & (POLLHUP | POLLERR | POLLNVAL | POLLRDHUP)))
-					status |= SHOULD_CLOSE;
+		if (readable || reader == THREAD_READER)
+			receive();
+		decode(budget);
+		should_refresh |= apply();
+		init_new_colors();
+		ring_bell();
+		return should_refresh;
+	}
 
-				ret = read(master, buffer, sizeof buffer);
-				if (ret <= 0) {
-					if (state.is_text && state.out != "") {
-						flush();
-						return 1;
-					}
-					return should_refresh; // No data or closed
-				}
-			}
-			if (state.is_text) {
-				state.esc_seq = "";
-				if (buffer[i] < 32 && DEBUG && master != 2 && buffer[i] != 27)
-					print_debug('[' + std::to_string((int) buffer[i]) + ']' + ((buffer[i] >= 0) ? ASCII_names[buffer[i]] : ""));
-				switch (buffer[i]) {
-					case '\x1B':
-					if (state.out != "") {
-						flush();
-						should_refresh = 1;
-					}
-					state.is_text = false;
-					state.ctrl.clear();
-					state.esc_type = buffer[i];
-					continue;
+	bool Window::ring_bell() {
+		if (!bell)
+			return false;
+		beep();
+		bell = false;
+		return true;
+	}
 
-					case '\t': {
-						int x, y;
-						getyx(win, y, x);
-						for (int p : state.tabstop) {
-							if (p > x) {
-								flush();
-								wmove(win, y, p);
-								goto cont;
-							}
-						}
-						break;
-					}
-					cont:
-					continue;
+	size_t Window::decode(size_t budget) {
+		size_t decoded = 0;
+		// Text actions point into the buffer, so it is only consumed once they have been applied
+		while (budget > 0 && output_buffer.size() > decoder.parsed) {
+			size_t len;
+			const char* data = output_buffer.read_area(len, decoder.parsed);
+			len = std::min(len, budget);
+			vt_parse(decoder, data, len);
+			decoder.parsed += len;
+			budget -= len;
+			decoded += len;
+		}
+		return decoded;
+	}
 
-					case '\r': {
-						if (state.out != "") {
-							flush();
-							should_refresh = 1;
-						}
-						int x, y;
-						getyx(win, y, x);
-						wmove(win, y, 0);
-					}
-					continue;
+	// Sequences that act on other windows, the screen or the system; everything else only changes the window itself
+	bool needs_main_thread(const decoder_state& decoder, const parser_action& action) {
+		if (action.type != OSC_ACTION && action.type != ESCAPE_ACTION)
+			return false;
+		const vt_sequence& seq = decoder.sequence(action);
+		if (action.type == OSC_ACTION)
+			return seq.ctrl.size() > 0 && seq.ctrl[0] == 50;
+		if (action.type != ESCAPE_ACTION || action.esc_type != '[')
+			return false;
+		// Window manipulation, and the start of a synchronized update (which draws the window)
+		return action.final == 't' || (action.final == 'h' && seq.collected.view() == "?" && seq.ctrl.size() > 0 && seq.ctrl[0] == 2026);
+	}
 
-					case '\n': {
-						if (state.out != "") {
-							flush();
-							should_refresh = 1;
-						}
-						int x, y, top, bot;
-						getyx(win, y, x);
-						if (state.auto_nl)
-							x = 0;
-						wgetscrreg(win, &top, &bot);
-						if (y >= bot) {
-							scroll(win);
-							wmove(win, y, x);
-						} else {
-							wmove(win, y + 1, x);
-						}
-						flush();
-					}
-					continue;
+	int Window::apply(bool in_pool) {
+		if (decoder.actions.empty()) {
+			output_buffer.consume(decoder.parsed);
+			decoder.parsed = 0;
+			return 0;
+		}
 
-					case 14:
-					state.vt220 = true;
-					continue;
+		// Output that would scroll out of the window anyway is not drawn; only what changes the state is applied
+		size_t start = 0;
+		if (next_action == 0) {
+			start = jump_scroll_start();
+			if (start > 0) {
+				screen.clear();
+				screen.move(0, 0);
+				state.carry_len = 0;
+				state.flags &= ~WRAP_PENDING;
+			}
+			coalesce(start);
+			skipped_until = start;
+		}
+		start = skipped_until;
+		for (size_t i = next_action; i < decoder.actions.size(); i++) {
+			parser_action& action = decoder.actions[i];
+			// On a worker thread, the rest is left for the main thread from the first sequence that needs it
+			if (in_pool && needs_main_thread(decoder, action)) {
+				next_action = i;
+				return 1;
+			}
+			if ((action.type == TEXT_ACTION || action.type == NO_ACTION) && !action.text.empty()
+					&& utf8_complete_length(action.text) == action.text.length()) {
+				// Kept for REP, even if the text itself is not drawn
+				size_t last = action.text.length() - 1;
+				while (last > 0 && (action.text[last] & 0xc0) == 0x80 && action.text.length() - last < sizeof state.last_char)
+					last--;
+				state.last_char_len = action.text.length() - last;
+				memcpy(state.last_char, action.text.data() + last, state.last_char_len);
+			}
+			if (action.type == NO_ACTION)
+				continue;
+			if (i < start && (action.type == TEXT_ACTION || (action.type == CONTROL_ACTION && action.final != 14 && action.final != '\x0F' && action.final != '\a')))
+				continue;
+			if (action.type == TEXT_ACTION) {
+				add_text(action.text);
+				continue;
+			}
 
-					case '\a':
-					beep();
-					continue;
+			// A character cut off by a control character or sequence is drawn as it is
+			if (state.carry_len > 0) {
+				flush(std::string_view(state.carry, state.carry_len));
+				state.carry_len = 0;
+			}
+			// Anything but a change of attributes cancels a pending line wrap
+			if (action.type != ESCAPE_ACTION || action.esc_type != '[' || action.final != 'm')
+				state.flags &= ~WRAP_PENDING;
+			if (action.type == CONTROL_ACTION) {
+				do_control(action.final);
+				continue;
+			}
 
-					case '\x0F':
-					state.vt220 = false;
-					continue;
+			// Sequences are handled with the same state as they would be while parsing
+			const vt_sequence& seq = decoder.sequence(action);
+			state.esc_type = action.esc_type;
+			state.ctrl = seq.ctrl;
+			state.out = (action.type == ESCAPE_ACTION) ? seq.collected.view() : decoder.string(seq);
+			state.action = &action;
+			if (action.type == OSC_ACTION)
+				do_osc();
+			else if (action.type == DCS_ACTION)
+				do_dcs();
+			else
+				do_sequence(action.final);
+			state.out = "";
+			state.action = nullptr;
+		}
+		vt_clear(decoder);
+		next_action = 0;
+		output_buffer.consume(decoder.parsed);
+		decoder.parsed = 0;
+		return 1; // Even bare cursor movement needs the window refreshed
+	}
 
-					case '\b':
-					flush();
-					if (status & INSERT)
-						winsch(win, '\b');
-					else
-						waddch(win, '\b');
-					should_refresh = 1;
+	size_t Window::jump_scroll_start() {
+		int screens = (jump_scroll >= 0) ? jump_scroll : rwm::jump_scroll;
+		int height = screen.height;
+		if (screens <= 0 || screen.top != 0 || screen.bot != height - 1)
+			return 0;
+
+		// Only text, control characters, colors, character sets and OSC strings may be skipped
+		std::vector<parser_action>& actions = decoder.actions;
+		size_t end = 0;
+		int lines = 0;
+		for (; end < actions.size(); end++) {
+			parser_action& action = actions[end];
+			if (action.type == CONTROL_ACTION && action.final == '\n')
+				lines++;
+			else if (action.type == ESCAPE_ACTION && !(action.esc_type == '(' || (action.esc_type == '[' && action.final == 'm' && decoder.sequence(action).collected.empty())))
+				break;
+		}
+		if (lines <= std::max(screens, 2) * height)
+			return 0;
+
+		// Twice the height in line feeds scrolls everything out wherever the cursor was;
+		// the skipped part must end with a new line starting in the first column
+		int after = 0;
+		for (size_t i = end; i-- > 1;) {
+			if (actions[i].type != CONTROL_ACTION || actions[i].final != '\n')
+				continue;
+			if (after >= 2 * height && ((state.flags & AUTO_NEWLINE) || (actions[i - 1].type == CONTROL_ACTION && actions[i - 1].final == '\r')))
+				return i + 1;
+			after++;
+		}
+		return 0;
+	}
+
+	void Window::coalesce(size_t start) {
+		if (status & INSERT)
+			return;
+		int cols = screen.width;
+		std::vector<parser_action>& actions = decoder.actions;
+		int cover = -1;                 // Columns of the line that are overwritten later on; -1 = the line may change
+		bool same_line = true;          // Whether the actions after the '\r' (up to `end`) only write to its line
+		size_t end = actions.size();
+		for (size_t i = actions.size(); i-- > start;) {
+			parser_action& action = actions[i];
+			if (action.type == TEXT_ACTION)
+				continue;
+			if (action.type == ESCAPE_ACTION && action.esc_type == '[') {
+				const vt_sequence& seq = decoder.sequence(action);
+				if (seq.collected.empty() && (action.final == 'm' || (action.final == 'K' && (seq.ctrl.empty() || seq.ctrl[0] == 0 || seq.ctrl[0] == 2))))
 					continue;
+			}
+			if (action.type != CONTROL_ACTION || action.final != '\r') {
+				same_line = false;
+				continue;
+			}
 
-					default:
-					break;
+			// Text from the first column up to `end`; colors are always kept, they change the state
+			int width = 0;
+			bool erases = false, partial = false;
+			for (size_t j = i + 1; same_line && j < end; j++) {
+				if (actions[j].type == ESCAPE_ACTION) {
+					erases |= actions[j].final == 'K';
+				} else if (actions[j].type == TEXT_ACTION) {
+					std::string_view text = actions[j].text;
+					partial |= utf8_complete_length(text) < text.length();
+					for (size_t k = 0, len; k < text.length(); k += len)
+						width += utf8_char_width(text, k, len);
 				}
-				if (state.vt220) {
-					flush();
-					waddch(win, NCURSES_ACS(buffer[i]));
-				} else
-					state.out += buffer[i];
+			}
+			if (!same_line || width > cols || (partial && end == actions.size())) {
+				// Wrapped, left the line, or ends in a character that is not drawn yet
+				cover = -1;
 			} else {
-				state.esc_seq += buffer[i];
-				if (state.esc_type == '\xFF') {
-					if (buffer[i] == '\7' || buffer[i] == '\x9C' || buffer[i] == '\\') {
-						if (buffer[i] != '\\' || state.esc_seq[state.esc_seq.length() - 2] == '\033') {
-							do_osc();
-							should_refresh = 1;
-							state.is_text = true;
-							state.out = "";
-						} else
-							state.out += '\033';
-					} else if (buffer[i] != '\033')
-						state.out += buffer[i];
-					continue;
-				} else if (state.esc_type == '\x90') {
-					if (buffer[i] == '\\' || buffer[i] == '\7') {
-						do_dcs();
-						should_refresh = 1;
-						state.is_text = true;
-						state.out = "";
-					}
-					continue;
+				int reach = erases ? cols : width;
+				if (cover >= reach) {
+					for (size_t j = i + 1; j < end; j++)
+						if (actions[j].type == TEXT_ACTION || actions[j].final == 'K')
+							actions[j].type = NO_ACTION;
 				}
-				switch (buffer[i]) {
-				case 'A' ... 'I': case 'S' ... 'T': case 'd' ... 'f':
-				case 's': case 'u': case 'n': case 'W': case 'Z': case '`' ... 'a':
-				if (state.esc_type == '[')
-					move_cursor(buffer[i]);
-				else if (state.esc_type == '(' && buffer[i] == 'B')
-					state.vt220 = false;
-				else if (state.esc_type == '\x1B' && buffer[i] == 'H')
-					add_tabstop();
-				else if (DEBUG) {
-					print_debug(state.esc_seq);
-					should_refresh = 1;
-				}
-				break;
+				cover = std::max(cover, reach);
+			}
+			same_line = true;
+			end = i;
+		}
+	}
 
-				case 'J' ... 'M': case 'P': case 'X':
-				if (state.esc_type == '[') {
-					erase(buffer[i]);
-					should_refresh = 1;
-				} else if (state.esc_type == '\x1B' && buffer[i] == 'M') {
-					int x, y, top, bot;
-					getyx(win, y, x);
-					wgetscrreg(win, &top, &bot);
-					if (y <= top) {
-						wscrl(win, -1);
-						wmove(win, y - 1, x);
-					} else {
-						wmove(win, y - 1, x);
-					}
-				} else if (buffer[i] == 'P') {
-					state.esc_type = '\x90';
-					continue;
-				} else if (DEBUG) {
-					print_debug(state.esc_seq);
-					should_refresh = 1;
-				}
-				break;
+	void Window::add_text(std::string_view text) {
+		// Complete a character split across reads
+		if (state.carry_len > 0) {
+			size_t n = 0;
+			while (n < text.length() && state.carry_len + n < sizeof state.carry && (text[n] & 0xc0) == 0x80)
+				n++;
+			memcpy(state.carry + state.carry_len, text.data(), n);
+			state.carry_len += n;
+			text.remove_prefix(n);
+			if (text.empty() && utf8_complete_length(std::string_view(state.carry, state.carry_len)) < state.carry_len)
+				return;
+			flush(std::string_view(state.carry, state.carry_len));
+			state.carry_len = 0;
+		}
 
-				case 'h': case 'l': {
-					int n1 = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 0) : 0;
-					if (state.esc_type == '[' && state.out == "?")
-						do_private_seq(buffer[i]);
-					else if (state.esc_type == '[' && n1 == 4)
-						status = (buffer[i] == 'h') ? (status | INSERT) : (status & ~INSERT);
-					else if (state.esc_type == '[' && n1 == 20)
-						state.auto_nl = (buffer[i] == 'h');
-					else if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-				}
-				break;
+		// Text is drawn straight from the output buffer; only an incomplete trailing character is kept
+		size_t complete = utf8_complete_length(text);
+		if (complete < text.length()) {
+			state.carry_len = text.length() - complete;
+			memcpy(state.carry, text.data() + complete, state.carry_len);
+			text = text.substr(0, complete);
+		}
+		if (!text.empty())
+			flush(text);
+	}
 
-				case 'g':
-					if (state.esc_type == '[') {
-						if (state.ctrl[0] == 0)
-							remove_tabstop();
-						else if (state.ctrl[0] == 3)
-							state.tabstop.clear();
-					} else if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-				break;
+	void Window::do_control(char c) {
+		if (DEBUG && master != 2)
+			print_debug('[' + std::to_string((int) c) + ']' + ASCII_names[c]);
+		switch (c) {
+			case '\t': {
+				int p = state.tabstop.next(screen.x);
+				screen.move(screen.y, (p >= 0) ? p : screen.width - 1);
+			}
+			break;
 
-				case 't':
-					if (state.esc_type == '[') {
-						manipulate_window();
-					} else if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-				break;
+			case '\r':
+			screen.x = 0;
+			break;
 
-				case 'r':
-					if (state.esc_type == '[') {
-						int n1 = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 0) : 0;
-						int n2 = (state.ctrl.size() > 1) ? std::max(state.ctrl[1], 0) : 0;
-						int margins[2];
-						margins[0] = (n1 == 0) ? 0 : n1 - 1;
-						margins[1] = (n2 == 0) ? getmaxy(win) - 1 : n2 - 1;
-						wsetscrreg(win, margins[0], margins[1]);
-					} else if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-				break;
-				
-				case 'm':
-				if (state.esc_type == '[' && state.esc_seq[1] != '?')
-					set_attrib();
-				else if (DEBUG) {
-					print_debug(state.esc_seq);
-					should_refresh = 1;
-				}
-				break;
+			case '\n': case '\v': case '\f':
+			if (state.flags & AUTO_NEWLINE)
+				screen.x = 0;
+			if (screen.y >= screen.bot)
+				scroll_lines(screen.top, screen.bot, 1);
+			else
+				screen.y++;
+			break;
 
-				case 'c':
-				if (state.esc_type == '[') {
-					send("\033[?6c");
-				} else if (DEBUG) {
-					print_debug(state.esc_seq);
-					should_refresh = 1;
-				}
-				break;
+			case 14:
+			state.flags |= VT220_GRAPHICS;
+			break;
 
-				case '\x1B':
-				state.ctrl.clear();
-				state.esc_type = '\x1B';
-				state.out = "";
-				continue;
+			case '\a':
+			bell = true;
+			break;
 
-				default:
-				if (DEBUG) {
-					print_debug(state.esc_seq);
-					should_refresh = 1;
-				}
-				break;
+			case '\x0F':
+			state.flags &= ~VT220_GRAPHICS;
+			break;
 
-				case ';': case ':':
-				if (state.esc_type == ']')
-					state.esc_type = '\xFF';
-				else
-					state.ctrl.push_back(0);
-				continue;
+			case '\b':
+			screen.move(screen.y, screen.x - 1);
+			break;
+		}
+	}
 
-				case '?': case '(': case ')':
-				case '[' ... '_': case '>': case '$': case ' ':
-				if (state.ctrl.size() < 1 && state.esc_type == '\x1B')
-					state.esc_type = buffer[i];
-				else if (state.esc_type == '[' && buffer[i] == '^')
-					move_cursor(buffer[i]);
+	void Window::do_sequence(char c) {
+		switch (c) {
+			case 'A' ... 'I': case 'S' ... 'T': case 'd' ... 'f':
+			case 's': case 'u': case 'n': case 'W': case 'Z': case '`' ... 'a': case '^':
+			if (state.esc_type == '[')
+				move_cursor(c);
+			else if (state.esc_type == '(' && c == 'B')
+				state.flags &= ~VT220_GRAPHICS;
+			else if (state.esc_type == '\x1B' && c == 'H')
+				add_tabstop();
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case 'J' ... 'M': case 'P': case 'X': case '@':
+			if (state.esc_type == '[' && (c != '@' || state.out == "")) {
+				erase(c);
+			} else if (state.esc_type == '\x1B' && c == 'M') {
+				// Reverse index; at the top of the scrolling region, it scrolls down
+				if (screen.y == screen.top)
+					scroll_lines(screen.top, screen.bot, -1);
 				else
-					state.out += buffer[i];
-				continue;
+					screen.move(screen.y - 1, screen.x);
+			} else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
 
-				case '0' ... '9':
-				if (state.esc_type == '(' && buffer[i] == '0') {
-					state.vt220 = true;
-					break;
-				} else if (state.esc_type == '\x1B') {
-					if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-					break;
-				} else if (state.esc_type != '[' && state.esc_type != ']') {
-					if (DEBUG) {
-						print_debug(state.esc_seq);
-						should_refresh = 1;
-					}
-					break;
-				}
-				if (state.ctrl.size() < 1)
-					state.ctrl.push_back(0);
-				state.ctrl[state.ctrl.size() - 1] *= 10;
-				state.ctrl[state.ctrl.size() - 1] += buffer[i] - '0';
-				continue;
-				}
-				state.is_text = true;
-				//if (DEBUG && master != 2)
-				//	print_debug(state.esc_seq);
-				state.out = "";
-				continue;
+			case 'h': case 'l': {
+				int n1 = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 0) : 0;
+				if (state.esc_type == '[' && state.out == "?")
+					do_private_seq(c);
+				else if (state.esc_type == '[' && n1 == 4)
+					status = (c == 'h') ? (status | INSERT) : (status & ~INSERT);
+				else if (state.esc_type == '[' && n1 == 20)
+					state.flags = (c == 'h') ? (state.flags | AUTO_NEWLINE) : (state.flags & ~AUTO_NEWLINE);
+				else if (DEBUG)
+					print_debug(vt_describe(decoder, *state.action));
 			}
+			break;
+
+			case 'g':
+			if (state.esc_type == '[') {
+				if (state.ctrl.size() < 1 || state.ctrl[0] == 0)
+					remove_tabstop();
+				else if (state.ctrl[0] == 3)
+					state.tabstop.clear();
+			} else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case 't':
+			if (state.esc_type == '[')
+				manipulate_window();
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case 'r':
+			if (state.esc_type == '[') {
+				int n1 = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 0) : 0;
+				int n2 = (state.ctrl.size() > 1) ? std::max(state.ctrl[1], 0) : 0;
+				int margins[2];
+				margins[0] = (n1 == 0) ? 0 : n1 - 1;
+				margins[1] = (n2 == 0) ? screen.height - 1 : n2 - 1;
+				screen.set_region(margins[0], margins[1]);
+			} else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case 'p':
+			if (state.esc_type == '[' && (state.out == "?$" || state.out == "$"))
+				report_mode(state.out[0] == '?');
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case 'm':
+			if (state.esc_type == '[' && state.out == "")
+				set_attrib();
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			// VT220 with ANSI colors, which has ICH, DCH, ECH, IL and DL
+			case 'c':
+			if (state.esc_type == '[' && state.out == "")
+				send("\033[?62;22c");
+			else if (state.esc_type == '[' && state.out == ">")
+				send("\033[>1;10;0c");
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			// REP: repeats the last character printed; beyond a screenful, only the cursor position can still change
+			case 'b':
+			if (state.esc_type == '[' && state.out == "" && state.last_char_len > 0) {
+				int n = (state.ctrl.size() > 0) ? std::max(state.ctrl[0], 1) : 1;
+				int width = screen.width, cells = screen.height * width;
+				if (n > cells)
+					n -= (n - cells) / width * width;
+				// Drawn in chunks from the stack
+				char chunk[256];
+				int per_chunk = sizeof chunk / state.last_char_len;
+				for (int i = 0; i < std::min(n, per_chunk); i++)
+					memcpy(chunk + i * state.last_char_len, state.last_char, state.last_char_len);
+				for (; n > 0; n -= per_chunk)
+					add_text(std::string_view(chunk, std::min(n, per_chunk) * state.last_char_len));
+			} else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			case '0':
+			if (state.esc_type == '(')
+				state.flags |= VT220_GRAPHICS;
+			else if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
+
+			default:
+			if (DEBUG)
+				print_debug(vt_describe(decoder, *state.action));
+			break;
 		}
-		return should_refresh;
 	}
 }
@@ -6,6 +6,12 @@
 #include <vector>
 #include <unordered_map>
 #include <fstream>
+#include <cstdint>
+#include <atomic>
+#include <time.h>
+#include "ringbuffer.hpp"
+#include "vtparser.hpp"
+#include "screen.hpp"
 #define SEL_WIN ((int) rwm::windows.size() - 1)
 #ifdef NCURSES_EXT_COLORS
 #define HAS_EXT_COLOR true
@@ -30,6 +36,26 @@ namespace rwm {
 		MAXIMIZED = 512,        // Window is maximized
 		ZOMBIE = 1024,          // Window should be deleted but has not
 		CANNOT_RESIZE = 2048,   // Window cannot be resized
+		BRACKETED_PASTE = 4096, // Wrap pasted text in ESC[200~ and ESC[201~
+		SYNCHRONIZED = 8192,    // Process is drawing a synchronized update (mode 2026); win is not drawn to until it is done
+	};
+
+	enum READ_RESULT {
+		READ_AGAIN,             // Everything available has been read
+		READ_FULL,              // Output buffer is full
+		READ_HUP,               // Slave side has been closed
+	};
+
+	enum READER {
+		EPOLL_READER,           // Master is read by the main loop when epoll reports it readable
+		THREAD_READER,          // Master is read by the reader thread
+		URING_READER,           // Master is read through io_uring
+	};
+
+	enum REFRESH_POLICY {
+		REFRESH_FOCUSED,        // Window has focus
+		REFRESH_VISIBLE,        // Window is (at least partly) visible, but not focused
+		REFRESH_OCCLUDED,       // Window is completely covered by other windows
 	};
 
 	enum BOLD_MODE {
@@ -57,29 +83,79 @@ namespace rwm {
 		int x;                             // Column
 	};
 
+	enum PARSER_FLAGS {
+		VT220_GRAPHICS = 1,     // VT220 line drawing character set
+		AUTO_NEWLINE = 2,       // In user input, on carriage-return, insert new-line
+		LINE_WRAP = 4,          // Line-wrap
+		SHOW_CURSOR = 8,        // Cursor is visible
+		WRAP_PENDING = 16,      // Last column has been written; the next character goes to the next row
+	};
+
+	const int MAX_TAB_COLUMNS = 1024;         // Columns that can have a tab stop
+
+	// One bit per column
+	struct tab_stops {
+		uint64_t bits[MAX_TAB_COLUMNS / 64];
+
+		// Like in xterm, there is a tab stop every 8 columns to begin with
+		tab_stops() { for (uint64_t& word : bits) word = 0x0101010101010101ULL; }
+
+		void set(int x) { if (0 <= x && x < MAX_TAB_COLUMNS) bits[x / 64] |= 1ULL << (x % 64); }
+		void reset(int x) { if (0 <= x && x < MAX_TAB_COLUMNS) bits[x / 64] &= ~(1ULL << (x % 64)); }
+		void clear() { for (uint64_t& word : bits) word = 0; }
+
+		// First tab stop right of column x, -1 if there is none
+		int next(int x) const {
+			x = std::max(x + 1, 0);
+			if (x >= MAX_TAB_COLUMNS)
+				return -1;
+			uint64_t word = bits[x / 64] & (~0ULL << (x % 64));
+			for (int i = x / 64; ; word = bits[i]) {
+				if (word)
+					return i * 64 + __builtin_ctzll(word);
+				if (++i == MAX_TAB_COLUMNS / 64)
+					return -1;
+			}
+		}
+
+		// Last tab stop left of column x, -1 if there is none
+		int prev(int x) const {
+			x = std::min(x - 1, MAX_TAB_COLUMNS - 1);
+			if (x < 0)
+				return -1;
+			uint64_t word = bits[x / 64] & (~0ULL >> (63 - x % 64));
+			for (int i = x / 64; ; word = bits[i]) {
+				if (word)
+					return i * 64 + 63 - __builtin_clzll(word);
+				if (--i < 0)
+					return -1;
+			}
+		}
+	};
+
 	struct parser_state {
-		bool is_text = true;               // Currently reading text or escape sequence?
-		bool vt220 = false;                // VT220 mode?
-		std::string out = "";              // Text to output; when in escape mode, additional string/char parameters
-		std::vector<int> ctrl = {};        // List of numerical values passed by control sequence
-		char esc_type = 0;                 // Character after ESC
 		uint64_t color = DEFAULT_COLOR;    // Current color
+		chtype attrib = 0;                 // Current ncurses attribute state
 		short color_pair = 0;              // Current color pair (used with extended colors)
-		chtype attrib;                     // Current ncurses attribute state
+		uint64_t pair_color = DEFAULT_COLOR; // Color that color_pair was looked up for
+		char esc_type = 0;                 // Character after ESC
+		uint8_t flags = LINE_WRAP | SHOW_CURSOR; // See PARSER_FLAGS
 		ivec2 saved_cursor_pos = {0, 0};   // Saved cursor position
-		int cursor = 1;                    // Current cursor state
-		std::string esc_seq = "";          // Current escape sequence
-		bool auto_nl = false;              // In user input, on carriage-return, insert new-line
-		bool line_wrap = true;             // Line-wrap
-		std::vector<int> tabstop = {};     // List of tab stops
+		vt_params ctrl{};                  // Numerical values passed by control sequence
+		std::string_view out = "";         // Private marker and intermediate characters, or string of the sequence being handled
+		const parser_action* action = nullptr; // Sequence being handled (only kept for debug output)
+		tab_stops tabstop{};               // Tab stops
+		char carry[4] = {};                // Start of a UTF-8 character split across reads
+		uint8_t carry_len = 0;             // Bytes in carry
+		char last_char[4] = {};            // Last character printed, for REP
+		uint8_t last_char_len = 0;         // Bytes in last_char
 	};
 
 	struct Window {
 	public:
 		WINDOW* frame;          // Window frame
-		WINDOW* win;            // Window contents
-		WINDOW* alt_frame;      // Alternate buffer window frame
-		WINDOW* alt_win;        // Alternate buffer window contents
+		WINDOW* win;            // Window contents, as last drawn from `screen`
+		screen_buffer screen{}; // Window contents, as drawn by the process
 		std::string title = ""; // Frame title
 		ivec2 size = {0, 0};    // Window (frame) size
 		ivec2 pos = {0, 0};     // Window (frame) position
@@ -89,9 +165,30 @@ namespace rwm {
 		int status;             // Window status bits
 		int mouse_mode = 0;     // Current mouse reporting mode; 0 = OFF; other = see https://invisible-island.net/xterm/ctlseqs/ctlseqs.html#h2-Mouse-Tracking
 		bool should_refresh = true;
+		int shown_cells = -1;   // Cells of the frame that no other window covers (see rwm::update_layout); -1 = not known, drawn in full
+		bool readable = false;  // Master has data waiting to be read (set by the event loop)
+		int reader = EPOLL_READER;              // How the master is read (see READER)
+		std::atomic<bool> reader_paused{false}; // Reader thread stopped reading because output_buffer is full
+		std::atomic<bool> hung_up{false};       // Reader thread found the slave side closed
+		size_t deficit = 0;     // Bytes of output the scheduler still allows this window to parse
+		int refresh_rate[3] = {-1, -1, -1}; // Redraws per second for each REFRESH_POLICY; -1 = use global refresh_rate
+		int jump_scroll = -1;   // Window heights of output per pass beyond which scrolled-off lines are not drawn; -1 = use global jump_scroll
+		timespec last_render{}; // When the window was last rendered
+		timespec sync_start{};  // When the current synchronized update started
 	private:
 		int alt_win_no = 0;     // Index of alternate window buffer used
+		screen_buffer alt_screen{}; // Buffer not in use (swapped with `screen`)
+		bool single_buffer = false; // Whether the alternate buffer is the same as the main one
 		parser_state state{};   // Saved parser state
+		decoder_state decoder{}; // Decoder state; may be used by another thread during decode()
+		std::string send_queue = ""; // Input for the process that has not been written to the master yet
+		size_t sent = 0;        // Bytes at the start of send_queue that have already been written
+		bool waiting_to_send = false; // Whether the main loop watches the master for becoming writable
+		bool paste_dropped = false; // Whether the rest of the current paste is dropped (see max_send_queue)
+		size_t next_action = 0; // Decoded action apply() goes on with
+		size_t skipped_until = 0; // Decoded actions before this one are skipped by jump scrolling (see jump_scroll_start)
+		bool bell = false;      // Process rang the bell (BEL) since ring_bell() was last called
+		ring_buffer output_buffer{65536}; // Output read from the process, waiting to be parsed
 
 	// API
 	public:
@@ -99,15 +196,28 @@ namespace rwm {
 		Window(WINDOW* win, std::string title, int attrib, int master, int slave); // Creates internal window
 		static Window* create_debug();                                             // Creates debug window
 		void launch_program(std::vector<std::string> args);                        // Launches program with args in window
-		int output();                                                              // Outputs window to main buffer
-		void send(std::string msg);                                                // Send control sequence to process
-		void send(char c);                                                         // Send character to process
+		void receive();                                                            // Reads output of process into output_buffer (or resumes the reader thread)
+		int fill_buffer();                                                         // Reads as much output as fits into output_buffer; returns READ_RESULT
+		size_t pending();                                                          // Number of bytes of output waiting to be parsed
+		int output(size_t budget = SIZE_MAX);                                     // Parses at most `budget` bytes of output; returns whether window should be refreshed
+		size_t decode(size_t budget);                                              // Splits at most `budget` bytes of output into actions; returns bytes used (safe to run in parallel for different windows)
+		int apply(bool in_pool = false);                                           // Applies decoded actions to the window; returns whether window should be refreshed (safe to run in parallel for different windows if `in_pool`: the actions from the first one that needs the main thread on are left for apply() there)
+		bool ring_bell();                                                          // Rings the bell if the process did since the last call; returns whether it did (main thread only)
+		void send(std::string msg);                                                // Send control sequence to process (queued until flush_input)
+		void send(char c);                                                         // Send typed character to process (queued until flush_input)
+		void paste(const std::string& text, int flags);                            // Send part of a paste (see PASTE_FLAGS) to process, bracketed if it asked for it
+		bool can_send();                                                           // Whether more input may be queued for the process (see max_send_queue)
+		void flush_input();                                                        // Writes as much queued input to the process as it accepts without blocking
 		void render(bool is_focused);                                              // Fully renders window, including frame
+		void draw();                                                               // Copies the rows of `screen` that changed into win (only the parts that are shown)
 		void move(ivec2 pos);                                                      // Moves window to specified coordinates (absolute)
 		void move_by(ivec2 d);                                                     // Moves window by specified vector (relative)
 		void resize(ivec2 size);                                                   // Resizes window to new dimensions
 		void maximize();                                                           // Maximise or unmaximise window based on flags
-		void flush();                                                              // Flushes output in output buffer to window
+		void fit_screen();                                                         // Fits the screen buffers to win and tells the process the new size
+		void flush(std::string_view text = "");                                   // Draws text with the current attributes (just applies them if there is none)
+		void scroll_lines(int top, int bot, int n);                                // Scrolls rows top to bot up by n rows (down if n is negative)
+		void synchronize(bool on);                                                 // Starts or ends a synchronized update; until it ends, render() shows the contents from its start
 		void flatten_buffers();                                                    // Flattens output buffers into one
 		void clear_frame();                                                        // Clears window frame
 		int destroy();                                                             // Destroys window (use before deleting!)
@@ -119,16 +229,30 @@ namespace rwm {
 		void do_osc();                        // Handle Operating System Control sequences
 		void do_dcs();                        // Handle Device Control String sequences
 		void do_private_seq(char mode);       // Handle private sequences
-		void move_cursor(char mode);          // Move cursor based on input char (for external API, use ncurses wmove(win, y, x))
+		void move_cursor(char mode);          // Move cursor based on input char (for external API, use screen.move(y, x))
+		size_t jump_scroll_start();           // Index of the first decoded action whose output would still be visible (see jump_scroll)
+		void coalesce(size_t start);          // Turns rewrites of a line (after '\r') that later ones fully overwrite into NO_ACTION
 		void erase(char mode);                // Erase part of screen based on input char
+		void shift_row(int n);                // Shifts the rest of the row right by n columns (left if negative), blanking what is freed
+		bool partly_shown();                  // Whether other windows cover some, but not all of the window
+		void draw_span(int y, int from, int to); // Copies columns from to to - 1 of row y of `screen` into win
 		void manipulate_window();             // Manipulate window
+		void report_mode(bool dec);           // Answers a request for the state of an ANSI or DEC private mode (DECRQM)
+		void add_text(std::string_view text);       // Draws text, keeping back a trailing incomplete UTF-8 character
+		void do_control(char c);              // Handle control characters
+		void do_sequence(char c);             // Handle escape sequence ending with c
 		void add_tabstop();
 		void remove_tabstop();
 	};
 	
+	const size_t max_send_queue = 1 << 20;    // Queued input beyond which input for the process is dropped until it catches up
+	extern int jump_scroll;                   // Window heights of output per pass beyond which lines that scroll off are not drawn; 0 = always draw
+
 	extern std::vector<Window*> windows;      // Currently open windows
 	extern bool selected_window;              // Is a window selected (if so, it's the top window of `windows`)
 	void print_debug(std::string msg);        // Print debug message `msg` to stdscr
+	void init_colors();                       // Starts ncurses' colors and numbers the base colors (after initscr or newterm)
+	void init_new_colors();                   // Passes the colors and color pairs that windows have numbered since the last call to ncurses (main thread only)
 
 	void set_color_rgb(WINDOW* win, char red_fg, char green_fg, char blue_fg, char red_bg, char green_bg, char blue_bg); // Set color (24 bit RGB)
 	void set_color_vga(WINDOW* win, int color_fg, int color_bg);                                                       // Set color (VGA)
@@ -0,0 +1,170 @@
+// Checks that parsing output does not allocate once a window is warmed up: a canned stream of compiler-style
+// output is fed to a window through a pipe, vt_parse and Window::apply, while operator new counts allocations.
+// With `bench`, it measures how fast the same stream, and one of plain text, are parsed instead: by vt_parse
+// alone, and by a window, where decoding and applying the actions are timed separately.
+//
+// Usage: alloc_check [bench [MiB]]
+#include <ncurses.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include "../source/windows.hpp"
+
+using namespace rwm;
+
+bool counting = false;          // Whether allocations are counted
+size_t allocations = 0;         // Allocations while counting
+
+void* operator new(size_t size) {
+	if (counting)
+		allocations++;
+	if (void* p = malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+// GCC takes the free() in a replaced operator delete for a mismatch
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	operator delete(p);
+}
+
+int in, out;                    // Pipe the window reads the stream from
+double decode_time = 0;         // Seconds spent in decode()
+double apply_time = 0;          // Seconds spent in apply()
+
+// Output like that of a compiler: colored file names, plain text with UTF-8 quotes, and line breaks
+std::string canned_stream() {
+	std::string s;
+	for (int i = 0; i < 200; i++) {
+		s += "\033[01m\033[K../source/windows.cpp:" + std::to_string(1000 + i * 7) + ":" + std::to_string(i % 80) + ":\033[m\033[K ";
+		s += "\033[01;35m\033[Kwarning: \033[m\033[Kunused variable \xe2\x80\x98" "attrib_" + std::to_string(i) + "\xe2\x80\x99 [\033[01;35m\033[K-Wunused-variable\033[m\033[K]\r\n";
+		s += "  " + std::to_string(1000 + i * 7) + " |                 int attrib_" + std::to_string(i) + " = state.attrib;\r\n";
+		s += "      |                     ^~~~~~~\r\n";
+	}
+	return s;
+}
+
+// Lines of plain text, such as those of a log file or `cat` of a source file
+std::string text_stream() {
+	std::string s;
+	for (int i = 0; i < 400; i++)
+		s += "    " + std::string(i % 7 * 4, ' ') + "line " + std::to_string(i) + " of a plain text file with no colors in it at all, "
+		     + std::string(i % 23, 'x') + "\r\n";
+	return s;
+}
+
+double seconds(const timespec& start) {
+	timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Feeds the stream in reads of an odd size, so sequences and UTF-8 characters are split across them
+void feed(Window* w, const std::string& stream) {
+	const size_t chunk = 4093;
+	for (size_t i = 0; i < stream.length(); i += chunk) {
+		size_t len = std::min(chunk, stream.length() - i);
+		if (write(out, stream.data() + i, len) != (ssize_t) len)
+			perror("write");
+		w->readable = true;
+		w->receive();
+		timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		w->decode(SIZE_MAX);
+		decode_time += seconds(start);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		w->apply();
+		apply_time += seconds(start);
+	}
+}
+
+// Measures vt_parse on its own, then a window decoding and applying `stream` until `bytes` went through each
+void measure(Window* w, const char* name, const std::string& stream, size_t bytes) {
+	decoder_state decoder;
+	const size_t chunk = 4093;
+	size_t parsed = 0;
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (; parsed < bytes; parsed += stream.length()) {
+		for (size_t i = 0; i < stream.length(); i += chunk) {
+			vt_parse(decoder, stream.data() + i, std::min(chunk, stream.length() - i));
+			vt_clear(decoder);
+		}
+	}
+	double parse_time = seconds(start);
+
+	for (int i = 0; i < 4; i++)
+		feed(w, stream);
+	decode_time = apply_time = 0;
+	size_t fed = 0;
+	for (; fed < bytes; fed += stream.length())
+		feed(w, stream);
+	printf("alloc_check: %s: vt_parse %.0f MB/s; in a window, decode %.0f MB/s, apply %.0f MB/s, both %.0f MB/s\n", name,
+	       parsed / parse_time / 1e6, fed / decode_time / 1e6, fed / apply_time / 1e6, fed / (decode_time + apply_time) / 1e6);
+}
+
+int main(int argc, char* argv[]) {
+	bool bench = argc > 1 && std::string(argv[1]) == "bench";
+	size_t bench_bytes = (size_t) ((argc > 2) ? atoi(argv[2]) : 64) << 20;
+
+	setlocale(LC_CTYPE, "C.UTF-8");
+	if (!newterm("xterm-256color", fopen("/dev/null", "w"), fopen("/dev/null", "r"))) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	init_colors();
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	in = fds[0];
+	out = fds[1];
+	fcntl(in, F_SETFL, O_NONBLOCK);
+
+	Window* w = new Window(newwin(24, 80, 0, 0), "check", 0, in, -1);
+	std::string stream = canned_stream();
+	// The first passes grow the buffers and number the colors
+	for (int i = 0; i < 4; i++)
+		feed(w, stream);
+	if (bench) {
+		measure(w, "compiler output", stream, bench_bytes);
+		measure(w, "plain text", text_stream(), bench_bytes);
+		endwin();
+		return 0;
+	}
+	counting = true;
+	for (int i = 0; i < 16; i++)
+		feed(w, stream);
+	counting = false;
+	endwin();
+
+	if (allocations > 0) {
+		fprintf(stderr, "alloc_check: %zu allocations while parsing %zu bytes\n", allocations, stream.length() * 16);
+		return 1;
+	}
+	printf("alloc_check: no allocations while parsing %zu bytes\n", stream.length() * 16);
+	return 0;
+}
@@ -0,0 +1,108 @@
+// Checks how terminal input is decoded when it arrives in pieces: a key sequence, mouse report or paste marker
+// cut short by a read is completed by the next one, and a key sequence that is never completed (a lone ESC)
+// is taken as it is once it has waited for the rest long enough.
+//
+// Usage: input_check
+#include <ncurses.h>
+#include <unistd.h>
+#include <time.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../source/input.hpp"
+
+using namespace rwm;
+
+int terminal;                   // Write end of the pipe that stands in for stdin
+
+// Keys read after each piece of input was written, joined with a space between reads
+std::string read_pieces(const std::vector<std::string>& pieces) {
+	std::string keys;
+	std::vector<input_event> events;
+	for (size_t i = 0; i < pieces.size(); i++) {
+		if (write(terminal, pieces[i].data(), pieces[i].length()) != (ssize_t) pieces[i].length())
+			perror("write");
+		read_input(events);
+		if (i > 0)
+			keys += " ";
+		for (input_event& ev : events) {
+			if (ev.key == KEY_PASTE)
+				keys += "[" + ev.text + "]";
+			else if (ev.key == KEY_MOUSE)
+				keys += "mouse" + std::to_string(ev.mouse.x) + "," + std::to_string(ev.mouse.y);
+			else if (ev.key >= KEY_MIN)
+				keys += keyname(ev.key);
+			else if (ev.key == '\033')
+				keys += "ESC";
+			else
+				keys += (char) ev.key;
+		}
+	}
+	return keys;
+}
+
+std::string check_split_keys() {
+	struct example {
+		std::vector<std::string> pieces;
+		std::string keys;
+	};
+	std::vector<example> examples = {
+		{{"\033[", "A"}, " KEY_UP"},
+		{{"a\033O", "Bb"}, "a KEY_DOWNb"},
+		{{"\033[1", "5~"}, " KEY_F(5)"},
+		{{"\033", "[15", "~x"}, "  KEY_F(5)x"},
+		{{"\033[<0;5", ";7M"}, " mouse4,6"},
+		{{"\033[20", "0~pasted\033[2", "01~"}, " [][pasted] []"},
+		// Not the beginning of any key sequence: Alt+x
+		{{"\033x"}, "ESCx"},
+	};
+	for (example& e : examples) {
+		std::string keys = read_pieces(e.pieces);
+		if (keys != e.keys)
+			return "read " + keys + " instead of " + e.keys;
+	}
+
+	// A lone ESC waits for the rest of a sequence, though not forever
+	std::string keys = read_pieces({"\033"});
+	if (!keys.empty() || input_timeout() < 0)
+		return "lone ESC read as " + keys + " right away";
+	timespec wait = {0, (input_timeout() + 5) * 1000000L};
+	nanosleep(&wait, nullptr);
+	keys = read_pieces({""});
+	if (keys != "ESC" || input_timeout() != -1)
+		return "lone ESC read as " + keys + " after the wait";
+	return "";
+}
+
+int main() {
+	int fds[2];
+	if (pipe(fds) == -1 || dup2(fds[0], 0) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	terminal = fds[1];
+	if (!newterm("xterm-256color", fopen("/dev/null", "w"), fopen("/dev/null", "r"))) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	// keybound only knows the terminal's keys once keypad is on
+	keypad(stdscr, TRUE);
+	init_input();
+
+	std::vector<std::pair<std::string, std::string (*)()>> checks = {
+		{"keys split across reads", check_split_keys},
+	};
+	std::vector<std::string> failures;
+	for (auto& [name, check] : checks) {
+		std::string result = check();
+		if (!result.empty())
+			failures.push_back(name + ": " + result);
+	}
+	endwin();
+
+	for (const std::string& f : failures)
+		fprintf(stderr, "input_check: %s\n", f.c_str());
+	if (failures.empty())
+		printf("input_check: %zu checks passed\n", checks.size());
+	return failures.empty() ? 0 : 1;
+}
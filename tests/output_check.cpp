@@ -0,0 +1,339 @@
+// Checks that what the direct output backend (direct_output) sends turns the terminal's screen into the frame:
+// random frames are drawn by a window covering the whole screen and sent with update_screen() to a pseudoterminal
+// that stands for the terminal; an RWM window, as the terminal emulator, parses what comes out, and its screen
+// must then match the frame cell by cell. The frames move the cursor about, erase runs of blanks, draw wide and
+// combining characters and the bottom right cell, and scroll a region (which the backend does with csr and indn).
+// Cursor movements must be the shortest the entry has. With an entry that has no cup, the backend is not used,
+// and the frames are shown all the same (by ncurses).
+//
+// Usage: output_check <directory etc/rwm.terminfo was compiled into with tic -x>
+#include <ncurses.h>
+#include <pty.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <sys/wait.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../source/windows.hpp"
+#include "../source/output.hpp"
+
+using namespace rwm;
+
+int master, slave;                      // Pseudoterminal standing for the terminal; its slave is stdout
+int real_stdout;                        // Where results are printed
+int emulator_out;                       // Pipe the emulator reads what the terminal was sent from
+Window* emulator;                       // Terminal emulator, parsing what the terminal was sent
+Window* frame;                          // Window drawing the frames, over the whole screen
+
+// Passes everything sent to the terminal to the emulator, letting the backend write the rest of its frame
+// as the terminal takes it; returns what was sent
+std::string pass_on() {
+	std::string sent;
+	char buf[16384];
+	while (true) {
+		flush_output();
+		pollfd p{master, POLLIN, 0};
+		if (poll(&p, 1, 20) <= 0)
+			break;
+		ssize_t n = read(master, buf, sizeof buf);
+		if (n <= 0)
+			break;
+		sent.append(buf, n);
+		if (write(emulator_out, buf, n) != n)
+			perror("write");
+		emulator->readable = true;
+		emulator->receive();
+		emulator->decode(SIZE_MAX);
+		emulator->apply();
+		init_new_colors();
+	}
+	return sent;
+}
+
+// Feeds `s` to the window that draws the frames
+void feed(Window* w, const std::string& s) {
+	for (size_t i = 0; i < s.length(); i += 16384) {
+		std::string part = s.substr(i, 16384);
+		if (write(w->slave, part.data(), part.length()) != (ssize_t) part.length())
+			perror("write");
+		w->readable = true;
+		w->receive();
+		w->decode(SIZE_MAX);
+		w->apply();
+	}
+	init_new_colors();
+}
+
+std::string describe(const cell& c) {
+	char s[64];
+	snprintf(s, sizeof s, "U+%04X+%04X attr %x pair %d", (unsigned) c.ch, (unsigned) c.comb, c.attr, c.pair);
+	return s;
+}
+
+// Where the emulator's screen differs from the frame
+std::string compare() {
+	for (int y = 0; y < LINES; y++)
+		for (int x = 0; x < COLS; x++)
+			if (frame->screen.row(y)[x] != emulator->screen.row(y)[x])
+				return "cell " + std::to_string(y) + "," + std::to_string(x) + " is " + describe(emulator->screen.row(y)[x])
+				     + " instead of " + describe(frame->screen.row(y)[x]);
+	if (frame->screen.y != emulator->screen.y || frame->screen.x != emulator->screen.x)
+		return "cursor at " + std::to_string(emulator->screen.y) + "," + std::to_string(emulator->screen.x) + " instead of "
+		     + std::to_string(frame->screen.y) + "," + std::to_string(frame->screen.x);
+	return "";
+}
+
+std::string at(int y, int x) {
+	return "\033[" + std::to_string(y + 1) + ";" + std::to_string(x + 1) + "H";
+}
+
+// Random changes to the frame
+std::string random_frame(int n) {
+	static const char* pieces[] = {
+		"text", "more text ", "\xc3\xa9t\xc3\xa9", "\xe4\xb8\xad\xe6\x96\x87", "e\xcc\x81", "\xe2\x94\x80\xe2\x94\x80",
+		"   ", "\033[K", "\033[12X", "\033[5X", "\033[44m      ", "\033[42m\033[20X", "\033[103m\033[K",
+	};
+	static const char* pens[] = {
+		"\033[m", "\033[1m", "\033[2m", "\033[3m", "\033[4m", "\033[5m", "\033[7m", "\033[22m", "\033[24;27m",
+		"\033[31m", "\033[92;44m", "\033[39m", "\033[49m", "\033[1;35;100m",
+	};
+	std::string s;
+	if (rand() % 3 == 0) {
+		// Rows scroll up or down, the last one stays
+		int lines = 1 + rand() % 6;
+		s += "\033[m\033[1;" + std::to_string(LINES - 1) + "r";
+		if (rand() % 2) {
+			s += at(LINES - 2, 0);
+			for (int i = 0; i < lines; i++)
+				s += "\nscrolled " + std::to_string(n) + "." + std::to_string(i) + " \033[3" + std::to_string(i % 8) + "mcolor\033[m";
+		} else {
+			s += at(0, 0);
+			for (int i = 0; i < lines; i++)
+				s += "\033Mreverse " + std::to_string(n) + "." + std::to_string(i) + "\r";
+		}
+		s += "\033[r";
+	}
+	for (int i = rand() % 12; i > 0; i--) {
+		s += at(rand() % LINES, rand() % COLS);
+		for (int j = rand() % 4; j >= 0; j--)
+			s += std::string(pens[rand() % (sizeof pens / sizeof *pens)]) + pieces[rand() % (sizeof pieces / sizeof *pieces)];
+	}
+	if (rand() % 5 == 0)
+		s += at(LINES - 1, COLS - 1) + "\033[1;33mZ";
+	if (rand() % 5 == 0)
+		s += at(rand() % LINES, COLS - 1) + "\xe5\xad\x97";
+	return s + "\033[m" + at(rand() % LINES, rand() % COLS);
+}
+
+// Draws `s` into the frame and shows it; returns what was sent to the terminal
+std::string show(const std::string& s) {
+	feed(frame, s);
+	frame->draw();
+	wnoutrefresh(stdscr);
+	update_screen();
+	return pass_on();
+}
+
+// Sequence with control characters spelled out
+std::string visible(const std::string& s) {
+	std::string v;
+	for (unsigned char c : s) {
+		if (c == '\033')
+			v += "\\E";
+		else if (c < ' ')
+			v += "^" + std::string(1, c + '@');
+		else
+			v += c;
+	}
+	return v;
+}
+
+const char* cap(const char* name) {
+	const char* s = tigetstr((char*) name);
+	return (s && s != (const char*) -1) ? s : nullptr;
+}
+
+// Length of the shortest way the entry has of moving the cursor from (fy, fx) to (y, x) in one go
+size_t shortest_move(int fy, int fx, int y, int x) {
+	std::vector<std::string> ways = {tiparm(cap("cup"), y, x)};
+	if (y == 0 && x == 0 && cap("home"))
+		ways.push_back(cap("home"));
+	int n = std::abs(x - fx) + std::abs(y - fy);
+	if (fy == y && fx == x) {
+		return 0;
+	} else if (fy == y) {
+		if (n == 1 && cap((x > fx) ? "cuf1" : "cub1"))
+			ways.push_back(cap((x > fx) ? "cuf1" : "cub1"));
+		if (cap((x > fx) ? "cuf" : "cub"))
+			ways.push_back(tiparm(cap((x > fx) ? "cuf" : "cub"), n));
+		if (cap("cr") && x == 0)
+			ways.push_back(cap("cr"));
+		if (cap("cr") && x == 1 && cap("cuf1"))
+			ways.push_back(std::string(cap("cr")) + cap("cuf1"));
+		if (cap("cr") && x > 0 && cap("cuf"))
+			ways.push_back(cap("cr") + std::string(tiparm(cap("cuf"), x)));
+		if (cap("hpa"))
+			ways.push_back(tiparm(cap("hpa"), x));
+	} else if (fx == x) {
+		// cud1 is a line feed
+		if (n == 1 && y < fy && cap("cuu1"))
+			ways.push_back(cap("cuu1"));
+		if (cap((y > fy) ? "cud" : "cuu"))
+			ways.push_back(tiparm(cap((y > fy) ? "cud" : "cuu"), n));
+		if (cap("vpa"))
+			ways.push_back(tiparm(cap("vpa"), y));
+	}
+	size_t best = SIZE_MAX;
+	for (const std::string& w : ways)
+		best = std::min(best, w.length());
+	return best;
+}
+
+std::string check_frames() {
+	for (int n = 0; n < 200; n++) {
+		show(random_frame(n));
+		std::string result = compare();
+		if (!result.empty())
+			return "frame " + std::to_string(n) + ": " + result;
+	}
+	return "";
+}
+
+std::string check_moves() {
+	// On a blank screen in the default colors, nothing but the cursor (and the character written) goes out
+	show("\033[m\033[2J\033[H");
+	for (int i = 0; i < 1000; i++) {
+		int fy = frame->screen.y, fx = frame->screen.x;
+		// Same row, same column, or anywhere
+		int y = (i % 3 == 0) ? fy : rand() % LINES;
+		int x = (i % 3 == 1) ? fx : rand() % (COLS - 1);
+		// The character written is one the cell does not have yet
+		char c = (frame->screen.row(y)[x].ch == 'x') ? 'y' : 'x';
+		std::string sent = (i % 2) ? show(at(y, x)) : show(at(y, x) + c);
+		size_t best = shortest_move(fy, fx, y, x) + (i % 2 ? 0 : 1);
+		// A few cells are written over rather than moved across
+		if (!(i % 2) && y == fy && x > fx && x - fx <= 3)
+			best = std::min(best, (size_t) (x - fx + 1));
+		if (sent.length() != best)
+			return "from " + std::to_string(fy) + "," + std::to_string(fx) + " to " + std::to_string(y) + "," + std::to_string(x)
+			     + ": sent " + visible(sent) + " instead of " + std::to_string(best) + " bytes";
+		std::string diff = compare();
+		if (!diff.empty())
+			return diff;
+	}
+	return "";
+}
+
+std::string check_without_cup() {
+	if (writes_directly())
+		return "frames are written directly";
+	for (int n = 0; n < 20; n++) {
+		show(random_frame(n));
+		std::string result = compare();
+		if (!result.empty())
+			return "frame " + std::to_string(n) + ": " + result;
+	}
+	return "";
+}
+
+// Shows frames on a pseudoterminal with the terminfo entry `term` in `dir`, running `checks`; prints the results
+int run(const char* term, const char* dir, const std::vector<std::pair<std::string, std::string (*)()>>& checks) {
+	setlocale(LC_CTYPE, "C.UTF-8");
+	winsize size = {24, 80, 0, 0};
+	if (openpty(&master, &slave, nullptr, nullptr, &size) == -1) {
+		perror("openpty");
+		return 1;
+	}
+	termios raw;
+	tcgetattr(slave, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+
+	// The backend writes to stdout; results go to the real one once it is done
+	real_stdout = dup(STDOUT_FILENO);
+	dup2(slave, STDOUT_FILENO);
+	unsetenv("LINES");
+	unsetenv("COLUMNS");
+	setenv("TERMINFO", dir, 1);
+	if (!newterm(term, stdout, fopen("/dev/null", "r"))) {
+		dup2(real_stdout, STDOUT_FILENO);
+		fprintf(stderr, "%s: entry not found in %s\n", term, dir);
+		return 1;
+	}
+	init_colors();
+	direct_output = true;
+
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	emulator = new Window(newwin(LINES + 2, COLS + 2, 0, 0), "terminal", 0, fds[0], fds[1]);
+	emulator_out = fds[1];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return 1;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	frame = new Window(newwin(LINES, COLS, 0, 0), "frame", 0, fds[0], fds[1]);
+	frame->win = stdscr;
+	frame->screen.resize(LINES, COLS);
+	// The first frame covers what the windows drew of themselves when they were made
+	touchwin(stdscr);
+	show("\033[2J");
+
+	srand(1);
+	std::vector<std::string> failures;
+	for (auto& [name, check] : checks) {
+		std::string result = check();
+		if (!result.empty())
+			failures.push_back(std::string(term) + ": " + name + ": " + result);
+	}
+	endwin();
+	pass_on();
+	dup2(real_stdout, STDOUT_FILENO);
+
+	for (const std::string& f : failures)
+		fprintf(stderr, "output_check: %s\n", f.c_str());
+	return failures.empty() ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <compiled terminfo directory>\n", argv[0]);
+		return 2;
+	}
+
+	// The terminal's capabilities are read once, so an entry without cup gets a process of its own
+	std::string entry = std::string(argv[1]) + "/rwm-nocup.src";
+	FILE* f = fopen(entry.c_str(), "w");
+	if (!f) {
+		perror(entry.c_str());
+		return 1;
+	}
+	fputs("rwm-nocup|rwm without cursor addressing,\n\tcup@, use=rwm-256color,\n", f);
+	fclose(f);
+	std::string tic = "TERMINFO='" + std::string(argv[1]) + "' tic -x -o '" + argv[1] + "' '" + entry + "'";
+	if (system(tic.c_str()) != 0) {
+		fprintf(stderr, "output_check: %s failed\n", tic.c_str());
+		return 1;
+	}
+	pid_t pid = fork();
+	if (pid == 0)
+		return run("rwm-nocup", argv[1], {{"without cup", check_without_cup}});
+	int status = 1;
+	waitpid(pid, &status, 0);
+
+	int failed = run("rwm-256color", argv[1], {{"random frames", check_frames}, {"cursor movements", check_moves}});
+	if (failed || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		return 1;
+	printf("output_check: frames shown as drawn, cursor moved the shortest way, not used without cup\n");
+	return 0;
+}
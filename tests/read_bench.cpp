@@ -0,0 +1,236 @@
+// Measures how much output RWM takes in from many busy windows at once: each window's process writes a share
+// of a canned stream of compiler-style output as fast as it can, while a loop like RWM's main loop waits for
+// events, parses the output and draws a frame 60 times a second. This is timed with the main loop reading the
+// masters itself, with the reader thread reading them, and through io_uring (where it is built in and the
+// kernel has it), along with the CPU time RWM takes and the system calls it makes. Then a key is typed into
+// every window each frame, to see what writing input with a plain write() per window costs.
+// System calls are counted by wrapping the calls RWM's code makes (see scripts/build.sh).
+//
+// Usage: read_bench [MiB [windows...]]
+#include <ncurses.h>
+#include <pty.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <time.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../source/windows.hpp"
+#include "../source/events.hpp"
+#include "../source/rwm.h"
+#include "../source/uring.hpp"
+
+using namespace rwm;
+
+std::atomic<long> syscalls{0};          // System calls made by RWM's code
+std::atomic<long> writes{0};            // Of them, write()s
+
+extern "C" {
+	ssize_t __real_read(int fd, void* buf, size_t n);
+	ssize_t __real_write(int fd, const void* buf, size_t n);
+	int __real_epoll_wait(int fd, epoll_event* events, int max, int timeout);
+	int __real_epoll_ctl(int fd, int op, int target, epoll_event* ev);
+	int __real_poll(pollfd* fds, nfds_t n, int timeout);
+	int __real_ioctl(int fd, unsigned long request, void* arg);
+	long __real_syscall(long number, long a, long b, long c, long d, long e, long f);
+
+	ssize_t __wrap_read(int fd, void* buf, size_t n) { syscalls++; return __real_read(fd, buf, n); }
+	ssize_t __wrap_write(int fd, const void* buf, size_t n) { syscalls++; writes++; return __real_write(fd, buf, n); }
+	int __wrap_epoll_wait(int fd, epoll_event* events, int max, int timeout) { syscalls++; return __real_epoll_wait(fd, events, max, timeout); }
+	int __wrap_epoll_ctl(int fd, int op, int target, epoll_event* ev) { syscalls++; return __real_epoll_ctl(fd, op, target, ev); }
+	int __wrap_poll(pollfd* fds, nfds_t n, int timeout) { syscalls++; return __real_poll(fds, n, timeout); }
+	int __wrap_ioctl(int fd, unsigned long request, void* arg) { syscalls++; return __real_ioctl(fd, request, arg); }
+	long __wrap_syscall(long number, long a, long b, long c, long d, long e, long f) { syscalls++; return __real_syscall(number, a, b, c, d, e, f); }
+}
+
+enum MODES {
+	MAIN_LOOP_MODE,         // Masters read by the main loop (epoll)
+	READER_MODE,            // Masters read by the reader thread
+	URING_MODE,             // Masters read through io_uring
+};
+
+const char* mode_names[] = {"main loop", "reader thread", "io_uring"};
+
+struct result {
+	double mb_per_s;        // Output taken in
+	double cpu;             // CPU time of RWM (all its threads) per second
+	double syscalls_per_s;  // System calls of RWM per second
+	double typing_us;       // Time per frame spent in flush_input, which writes the typed keys
+	double writes_per_frame; // write()s of RWM per frame
+	bool used = true;       // Were the masters read the way that was asked for?
+};
+
+// Output like that of a compiler: colored file names, plain text with UTF-8 quotes, and line breaks
+std::string canned_stream() {
+	std::string s;
+	for (int i = 0; i < 200; i++) {
+		s += "\033[01m\033[K../source/windows.cpp:" + std::to_string(1000 + i * 7) + ":" + std::to_string(i % 80) + ":\033[m\033[K ";
+		s += "\033[01;35m\033[Kwarning: \033[m\033[Kunused variable \xe2\x80\x98" "attrib_" + std::to_string(i) + "\xe2\x80\x99 [\033[01;35m\033[K-Wunused-variable\033[m\033[K]\r\n";
+		s += "  " + std::to_string(1000 + i * 7) + " |                 int attrib_" + std::to_string(i) + " = state.attrib;\r\n";
+		s += "      |                     ^~~~~~~\r\n";
+	}
+	return s;
+}
+
+double seconds(const timespec& start) {
+	timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Window whose process writes `bytes` of `stream` to it and exits
+Window* open_window(const std::string& stream, size_t bytes, int y, int x) {
+	int master, slave;
+	if (openpty(&master, &slave, nullptr, nullptr, nullptr) == -1) {
+		perror("openpty");
+		exit(1);
+	}
+	fcntl(master, F_SETFL, fcntl(master, F_GETFL, 0) | O_NONBLOCK);
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		exit(1);
+	} else if (pid == 0) {
+		close(master);
+		termios raw{};
+		tcgetattr(slave, &raw);
+		cfmakeraw(&raw);
+		tcsetattr(slave, TCSANOW, &raw);
+		for (size_t sent = 0; sent < bytes;) {
+			ssize_t n = write(slave, stream.data(), std::min(stream.length(), bytes - sent));
+			if (n <= 0)
+				_exit(1);
+			sent += n;
+		}
+		_exit(0);
+	}
+	close(slave);
+	Window* w = new Window(newwin(26, 82, y, x), "bench", 0, master, -1);
+	w->pid = pid;
+	watch(master, w);
+	return w;
+}
+
+double cpu_seconds() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Runs the main loop until all `n` windows have written `bytes` between them and exited; with `typing`, a key is
+// typed into each window every frame
+result run(int n, size_t bytes, int mode, bool typing) {
+	reader_thread = (mode == READER_MODE);
+	use_io_uring = (mode == URING_MODE);
+	std::string stream = canned_stream();
+	timespec start, last_frame;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	last_frame = start;
+	double cpu = cpu_seconds();
+	long calls = syscalls, written = writes;
+	for (int i = 0; i < n; i++)
+		windows.push_back(open_window(stream, bytes / n, i % 20, i % 100));
+	result r;
+	r.used = (windows[0]->reader == ((mode == MAIN_LOOP_MODE) ? EPOLL_READER : (mode == READER_MODE) ? THREAD_READER : URING_READER));
+
+	bool pending = false;
+	double typing_time = 0;
+	long frames = 0;
+	while (true) {
+		wait_events(pending ? 0 : 16);
+		pending = parse_output();
+		timespec flush_start;
+		clock_gettime(CLOCK_MONOTONIC, &flush_start);
+		for (Window* w : windows)
+			w->flush_input();
+		typing_time += seconds(flush_start);
+		if (seconds(last_frame) >= 1 / 60.0) {
+			if (typing)
+				for (Window* w : windows)
+					w->send('x');
+			frames++;
+			for (Window* w : windows)
+				if (w->should_refresh)
+					w->render(false);
+			doupdate();
+			clock_gettime(CLOCK_MONOTONIC, &last_frame);
+		}
+
+		int closed = 0;
+		for (Window* w : windows)
+			closed += (w->status & SHOULD_CLOSE) ? 1 : 0;
+		if (closed == n)
+			break;
+	}
+	double t = seconds(start);
+	r.mb_per_s = bytes / n * n / t / 1e6;
+	r.cpu = (cpu_seconds() - cpu) / t;
+	r.syscalls_per_s = (syscalls - calls) / t;
+	r.typing_us = typing_time / std::max(frames, 1L) * 1e6;
+	r.writes_per_frame = (double) (writes - written) / std::max(frames, 1L);
+	r.used &= (mode != URING_MODE || use_io_uring);
+
+	for (Window* w : windows) {
+		waitpid(w->pid, nullptr, 0);
+		close(w->master);
+		delwin(w->win);
+		delwin(w->frame);
+		delete w;
+	}
+	windows.clear();
+	return r;
+}
+
+int main(int argc, char* argv[]) {
+	size_t bytes = (size_t) ((argc > 1) ? atoi(argv[1]) : 32) << 20;
+	std::vector<int> counts;
+	for (int i = 2; i < argc; i++)
+		counts.push_back(atoi(argv[i]));
+	if (counts.empty())
+		counts = {10, 50, 100};
+
+	setlocale(LC_CTYPE, "C.UTF-8");
+	if (!newterm("xterm-256color", fopen("/dev/null", "w"), fopen("/dev/null", "r"))) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	resizeterm(50, 200);
+	init_colors();
+	init_events();
+
+#ifdef RWM_IO_URING
+	int modes = 3;
+#else
+	int modes = 2;
+	printf("read_bench: built without io_uring\n");
+#endif
+	for (int n : counts) {
+		for (int mode = 0; mode < modes; mode++) {
+			result r = run(n, bytes, mode, false);
+			if (!r.used) {
+				printf("read_bench: %d windows, %s: not available\n", n, mode_names[mode]);
+				continue;
+			}
+			printf("read_bench: %d windows, %s: %.0f MB/s, %.0f%% CPU, %.0f system calls/s (%.0f per MB)\n", n, mode_names[mode],
+			       r.mb_per_s, r.cpu * 100, r.syscalls_per_s, r.syscalls_per_s / r.mb_per_s);
+		}
+
+		// Typed keys are written by the main loop whichever way the masters are read
+		result quiet = run(n, bytes, MAIN_LOOP_MODE, false);
+		result typed = run(n, bytes, MAIN_LOOP_MODE, true);
+		printf("read_bench: %d windows, a key typed into each every frame: %.1f write()s and %.0f us in flush_input per frame (%.0f us without typing), %.0f MB/s\n",
+		       n, typed.writes_per_frame, typed.typing_us, quiet.typing_us, typed.mb_per_s);
+	}
+	endwin();
+	close_events();
+	return 0;
+}
@@ -0,0 +1,158 @@
+// Replays canned streams of output into a window (93x30 inside its frame) and counts the calls RWM makes into
+// ncurses while parsing them, and while drawing the window after every read of 4 KiB (as the main loop would
+// once per frame, if the process wrote that much per frame). Parsing only changes the window's screen buffer;
+// drawing copies the rows that changed into ncurses. Calls are counted by wrapping the ncurses functions
+// windows.cpp and charencoding.cpp use (see scripts/build.sh).
+//
+// Usage: replay_bench
+#include <ncurses.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <time.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../source/windows.hpp"
+
+using namespace rwm;
+
+long calls = 0;                 // Calls into ncurses
+
+#define WRAP(ret, name, params, args) \
+	extern "C" ret __real_##name params; \
+	extern "C" ret __wrap_##name params { calls++; return __real_##name args; }
+
+WRAP(int, wmove, (WINDOW* w, int y, int x), (w, y, x))
+WRAP(int, wadd_wchnstr, (WINDOW* w, const cchar_t* s, int n), (w, s, n))
+WRAP(int, wadd_wch, (WINDOW* w, const cchar_t* c), (w, c))
+WRAP(int, waddch, (WINDOW* w, chtype c), (w, c))
+WRAP(int, waddnstr, (WINDOW* w, const char* s, int n), (w, s, n))
+WRAP(int, setcchar, (cchar_t* c, const wchar_t* s, attr_t a, short pair, const void* opts), (c, s, a, pair, opts))
+WRAP(int, wattr_set, (WINDOW* w, attr_t a, short pair, void* opts), (w, a, pair, opts))
+WRAP(int, wattr_on, (WINDOW* w, attr_t a, void* opts), (w, a, opts))
+WRAP(int, wattr_off, (WINDOW* w, attr_t a, void* opts), (w, a, opts))
+WRAP(int, wcolor_set, (WINDOW* w, short pair, void* opts), (w, pair, opts))
+WRAP(int, wtouchln, (WINDOW* w, int y, int n, int changed), (w, y, n, changed))
+WRAP(int, wnoutrefresh, (WINDOW* w), (w))
+WRAP(int, wborder, (WINDOW* w, chtype ls, chtype rs, chtype ts, chtype bs, chtype tl, chtype tr, chtype bl, chtype br), (w, ls, rs, ts, bs, tl, tr, bl, br))
+WRAP(int, init_extended_pair, (int pair, int f, int b), (pair, f, b))
+WRAP(int, init_extended_color, (int color, int r, int g, int b), (color, r, g, b))
+
+// A process monitor redrawing the whole screen: a colored header, then rows of figures that change a little each time
+std::string redraw_stream() {
+	std::string s;
+	for (int frame = 0; frame < 400; frame++) {
+		s += "\033[H\033[1;37;44m  PID USER      PRI  NI  VIRT   RES   SHR S CPU% MEM%   TIME+  Command" + std::string(22, ' ') + "\033[m";
+		for (int row = 2; row <= 30; row++) {
+			int pid = 1000 + row * 37;
+			s += "\033[" + std::to_string(row) + ";1H" + std::to_string(pid) + " \033[32mroot\033[m      20   0 "
+			     + std::to_string(100 + (row * frame) % 900) + "M \033[1m" + std::to_string((row + frame) % 97) + ".0\033[m  "
+			     + std::to_string(row * 3) + "M S \033[31m" + std::to_string((row * 7 + frame) % 100) + ".0\033[m  1.2  0:0"
+			     + std::to_string(frame % 10) + ".00 /usr/bin/process-" + std::to_string(row) + "\033[K";
+		}
+	}
+	return s;
+}
+
+// Log lines in a few colors, scrolling the window
+std::string log_stream() {
+	std::string s;
+	const char* levels[] = {"\033[32mINFO\033[m", "\033[33mWARN\033[m", "\033[1;31mERROR\033[m", "\033[36mDEBUG\033[m"};
+	for (int i = 0; i < 20000; i++)
+		s += "2026-10-18 12:00:" + std::to_string(i % 60) + " " + levels[i % 4] + " worker-" + std::to_string(i % 8)
+		     + ": handled request " + std::to_string(i) + " in " + std::to_string(i % 300) + " ms\r\n";
+	return s;
+}
+
+// Progress bars rewriting their line
+std::string progress_stream() {
+	std::string s;
+	for (int i = 0; i < 20000; i++) {
+		int done = i % 101;
+		s += "\r\033[1mdownloading\033[m [\033[32m" + std::string(done * 60 / 100, '#') + "\033[m" + std::string(60 - done * 60 / 100, '.') + "] "
+		     + std::to_string(done) + "%";
+		if (done == 100)
+			s += "\r\n";
+	}
+	return s;
+}
+
+// Numbers, one per line (like seq)
+std::string seq_stream() {
+	std::string s;
+	for (int i = 1; i <= 300000; i++)
+		s += std::to_string(i) + "\r\n";
+	return s;
+}
+
+// Characters deleted all over the screen
+std::string delete_stream() {
+	std::string s;
+	for (int row = 1; row <= 30; row++)
+		s += "\033[" + std::to_string(row) + ";1H" + std::string(93, 'a' + row % 26);
+	for (int i = 0; i < 50000; i++)
+		s += "\033[" + std::to_string(1 + i % 30) + ";" + std::to_string(1 + i * 7 % 93) + "H\033[" + std::to_string(1 + i % 5) + "P";
+	return s;
+}
+
+double seconds(const timespec& start) {
+	timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Replays `stream` in reads of 4 KiB, drawing the window after each
+void replay(const char* name, const std::string& stream) {
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	Window* w = new Window(newwin(32, 95, 0, 0), "replay", 0, fds[0], -1);
+	w->shown_cells = -1;
+	long parse_calls = 0, draw_calls = 0, draws = 0;
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const size_t chunk = 4096;
+	for (size_t i = 0; i < stream.length(); i += chunk) {
+		size_t len = std::min(chunk, stream.length() - i);
+		if (write(fds[1], stream.data() + i, len) != (ssize_t) len)
+			perror("write");
+		w->readable = true;
+		calls = 0;
+		w->output(SIZE_MAX);
+		parse_calls += calls;
+		calls = 0;
+		w->render(false);
+		draw_calls += calls;
+		draws++;
+	}
+	double t = seconds(start);
+	printf("replay_bench: %s: %.1f MB, %ld ncurses calls while parsing (%.2f per KB), %.0f per draw, %.0f MB/s\n", name,
+	       stream.length() / 1e6, parse_calls, parse_calls / (stream.length() / 1000.0), (double) draw_calls / draws, stream.length() / t / 1e6);
+	close(fds[0]);
+	close(fds[1]);
+	delwin(w->win);
+	delwin(w->frame);
+	delete w;
+}
+
+int main() {
+	setlocale(LC_CTYPE, "C.UTF-8");
+	if (!newterm("xterm-256color", fopen("/dev/null", "w"), fopen("/dev/null", "r"))) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	resizeterm(40, 100);
+	init_colors();
+
+	replay("full-screen redraws", redraw_stream());
+	replay("colored log", log_stream());
+	replay("progress bars", progress_stream());
+	replay("numbers", seq_stream());
+	replay("deleted characters", delete_stream());
+	endwin();
+	return 0;
+}
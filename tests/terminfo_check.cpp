@@ -0,0 +1,646 @@
+// Checks that every capability in etc/rwm.terminfo does what the entry says in an RWM window: each string
+// capability is expanded with tparm, fed through vt_parse and Window::apply, and its effect on the cursor and
+// the cells is compared with what terminfo means by it. A capability without a check here fails, so the entry
+// cannot advertise more than the parser handles.
+//
+// Usage: terminfo_check <path to rwm.terminfo> <directory it was compiled into with tic -x>
+#include <ncurses.h>
+#include <pty.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <functional>
+#include "../source/windows.hpp"
+#include "../source/input.hpp"
+
+using namespace rwm;
+
+struct capability {
+	std::string name;
+	char type;                      // '=' string, '#' number, '!' boolean
+	std::string str;                // Value of a string capability
+	int num = 0;                    // Value of a number capability
+};
+
+// Capabilities that are not sequences sent by the process (besides keys), and why
+const std::map<std::string, std::string> not_output = {
+	{"u6", "format of the cursor position report (checked with u7)"},
+	{"u8", "format of the device attributes report (checked with u9)"},
+	{"cols", "the window size is passed to the process with TIOCSWINSZ"},
+	{"lines", "the window size is passed to the process with TIOCSWINSZ"},
+	{"pairs", "color pairs are numbered by RWM, not by the process"},
+};
+
+int master, slave;                      // Pseudoterminal the windows read the sequences from
+std::map<std::string, capability> caps; // Capabilities of the entry being checked
+const int Y = 5, X = 10;                // Cursor position each check starts at
+
+char32_t pattern(int y, int x) {
+	return 'a' + (x + 3 * y) % 26;
+}
+
+// Window filled with pattern(), with the cursor at (Y, X)
+Window* fresh() {
+	Window* w = new Window(newwin(24, 80, 0, 0), "check", 0, master, -1);
+	for (int y = 0; y < w->screen.height; y++)
+		for (int x = 0; x < w->screen.width; x++)
+			w->screen.row(y)[x].ch = pattern(y, x);
+	w->screen.move(Y, X);
+	char buf[256];
+	while (read(slave, buf, sizeof(buf)) > 0);
+	return w;
+}
+
+void feed(Window* w, const std::string& seq) {
+	if (write(slave, seq.data(), seq.length()) != (ssize_t) seq.length())
+		perror("write");
+	w->readable = true;
+	w->receive();
+	w->decode(SIZE_MAX);
+	w->apply();
+	init_new_colors();
+}
+
+// What the window sent back to the process
+std::string reply(Window* w) {
+	w->flush_input();
+	std::string out;
+	char buf[256];
+	for (ssize_t n; (n = read(slave, buf, sizeof(buf))) > 0; )
+		out.append(buf, n);
+	return out;
+}
+
+std::string expand(const std::string& cap, long p1 = 0, long p2 = 0, long p3 = 0) {
+	char* s = tparm((char*) cap.c_str(), p1, p2, p3, 0L, 0L, 0L, 0L, 0L, 0L);
+	return s ? s : "";
+}
+
+// Whether a report has the format of u6 (%i, %d and %% in it are read like scanf formats, as in xterm's entry)
+bool matches_report(const std::string& report, const std::string& format, std::vector<int> values) {
+	size_t i = 0, next = 0;
+	int offset = 0;
+	for (size_t f = 0; f < format.length(); f++) {
+		if (format[f] == '%' && f + 1 < format.length() && format[f + 1] != '%') {
+			f++;
+			if (format[f] == 'i') {
+				offset = 1;
+				continue;
+			}
+			size_t end = report.find_first_not_of("0123456789", i);
+			if (format[f] != 'd' || end == i || next == values.size() || std::stoi(report.substr(i, end - i)) != values[next++] + offset)
+				return false;
+			i = end;
+			continue;
+		}
+		if (format[f] == '%')
+			f++;
+		if (i == report.length() || report[i++] != format[f])
+			return false;
+	}
+	return i == report.length() && next == values.size();
+}
+
+std::string expect(bool ok, const std::string& what) {
+	return ok ? "" : what;
+}
+
+std::string cursor_at(Window* w, int y, int x) {
+	if (w->screen.y == y && w->screen.x == x)
+		return "";
+	return "cursor at (" + std::to_string(w->screen.y) + ", " + std::to_string(w->screen.x) + "), expected (" + std::to_string(y) + ", " + std::to_string(x) + ")";
+}
+
+std::string cell_is(Window* w, int y, int x, char32_t ch) {
+	char32_t got = w->screen.row(y)[x].ch;
+	if (got == ch)
+		return "";
+	return "cell (" + std::to_string(y) + ", " + std::to_string(x) + ") is character " + std::to_string(got) + ", expected " + std::to_string(ch);
+}
+
+std::string blank(Window* w, int y, int x) {
+	return cell_is(w, y, x, ' ');
+}
+
+// Row y holds what row `from` held before
+std::string row_from(Window* w, int y, int from) {
+	for (int x = 0; x < w->screen.width; x++)
+		if (w->screen.row(y)[x].ch != pattern(from, x))
+			return "row " + std::to_string(y) + " does not hold what row " + std::to_string(from) + " did";
+	return "";
+}
+
+std::string row_blank(Window* w, int y) {
+	for (int x = 0; x < w->screen.width; x++)
+		if (w->screen.row(y)[x].ch != ' ')
+			return "row " + std::to_string(y) + " is not blank";
+	return "";
+}
+
+// Runs the checks in order; the first failure is the result
+std::string all(std::initializer_list<std::string> results) {
+	for (const std::string& r : results)
+		if (!r.empty())
+			return r;
+	return "";
+}
+
+std::string has_attr(Window* w, chtype attr, bool on) {
+	bool set = w->screen.row(Y)[X].attr & attr;
+	return expect(set == on, std::string("attribute ") + (on ? "not set" : "still set"));
+}
+
+// Color of the foreground (or background) of a cell, as ncurses was told it
+bool cell_rgb(Window* w, bool bg, int rgb[3]) {
+	int fg_index, bg_index;
+	if (extended_pair_content(w->screen.row(Y)[X].pair, &fg_index, &bg_index) == ERR)
+		return false;
+	int i = bg ? bg_index : fg_index;
+	return i >= 0 && extended_color_content(i, &rgb[0], &rgb[1], &rgb[2]) != ERR;
+}
+
+std::string color_is(Window* w, bool bg, int red, int green, int blue) {
+	int rgb[3];
+	if (w->screen.row(Y)[X].pair == 0 || !cell_rgb(w, bg, rgb))
+		return std::string("no ") + (bg ? "background" : "foreground") + " color";
+	// Without can_change_color, the closest of the colors the terminal has is used
+	if (!can_change_color())
+		return "";
+	return expect(rgb[0] == red && rgb[1] == green && rgb[2] == blue, "color is " + std::to_string(rgb[0]) + "," + std::to_string(rgb[1]) + "," + std::to_string(rgb[2]) + ", expected " + std::to_string(red) + "," + std::to_string(green) + "," + std::to_string(blue));
+}
+
+// Color n of the xterm 256 color palette, scaled to 0..1000
+std::string palette_is(Window* w, bool bg, int n) {
+	int rgb[3];
+	if (n < 16) {
+		extended_color_content(n, &rgb[0], &rgb[1], &rgb[2]);
+		return color_is(w, bg, rgb[0], rgb[1], rgb[2]);
+	} else if (n < 232) {
+		n -= 16;
+		rgb[0] = n / 36 * 51;
+		rgb[1] = n / 6 % 6 * 51;
+		rgb[2] = n % 6 * 51;
+	} else {
+		rgb[0] = rgb[1] = rgb[2] = (n - 231) * 255 / 25;
+	}
+	return color_is(w, bg, rgb[0] * 1000 / 255, rgb[1] * 1000 / 255, rgb[2] * 1000 / 255);
+}
+
+std::string set_color(const std::string& cap, bool bg) {
+	std::vector<int> numbers = {1, 6};
+	if (caps["colors"].num >= 256)
+		numbers.insert(numbers.end(), {9, 100, 250});
+	for (int n : numbers) {
+		Window* w = fresh();
+		feed(w, expand(cap, n) + "A");
+		std::string r = palette_is(w, bg, n);
+		if (!r.empty())
+			return "color " + std::to_string(n) + ": " + r;
+	}
+	return "";
+}
+
+std::string rgb_color(const std::string& cap, bool bg) {
+	Window* w = fresh();
+	feed(w, expand(cap, 255, 128, 0) + "A");
+	return color_is(w, bg, 1000, 128 * 1000 / 255, 0);
+}
+
+std::string starts_attr(const std::string& cap, chtype attr) {
+	Window* w = fresh();
+	feed(w, cap + "A");
+	return has_attr(w, attr, true);
+}
+
+std::string ends_attr(const std::string& cap, const std::string& start, chtype attr) {
+	Window* w = fresh();
+	feed(w, start + cap + "A");
+	return has_attr(w, attr, false);
+}
+
+std::string moves_to(const std::string& seq, int y, int x) {
+	Window* w = fresh();
+	feed(w, seq);
+	return cursor_at(w, y, x);
+}
+
+std::string mode_is(const std::string& seq, const std::string& mode, int state) {
+	Window* w = fresh();
+	feed(w, seq + "\033[" + mode + "$p");
+	std::string expected = "\033[" + mode + ";" + std::to_string(state) + "$y";
+	return expect(reply(w) == expected, "mode " + mode + " not " + (state == 1 ? "set" : "reset"));
+}
+
+std::string status_is(const std::string& seq, int bit, bool on) {
+	Window* w = fresh();
+	feed(w, seq);
+	return expect(((w->status & bit) != 0) == on, std::string("status bit not ") + (on ? "set" : "cleared"));
+}
+
+std::string line_drawing(Window* w, char c) {
+	chtype acs = NCURSES_ACS(c);
+	// Line drawing characters the terminal RWM runs in does not have are shown as they are
+	if (!(acs & A_CHARTEXT))
+		return "";
+	const cell& drawn = w->screen.row(Y)[X];
+	return expect(drawn.ch == (acs & A_CHARTEXT) && (drawn.attr & A_ALTCHARSET) == (acs & A_ALTCHARSET), std::string("'") + c + "' not drawn as a line drawing character");
+}
+
+// Checks of each capability; they get the value of a string capability (expanded by the check)
+const std::map<std::string, std::function<std::string(const capability&)>> checks = {
+	// Booleans and numbers
+	{"am", [](const capability&) {
+		Window* w = fresh();
+		w->screen.move(Y, w->screen.width - 1);
+		feed(w, "AB");
+		return all({cell_is(w, Y + 1, 0, 'B'), cursor_at(w, Y + 1, 1)});
+	}},
+	{"xenl", [](const capability&) {
+		Window* w = fresh();
+		w->screen.move(Y, w->screen.width - 1);
+		feed(w, "A\r\n");
+		return cursor_at(w, Y + 1, 0);
+	}},
+	{"msgr", [](const capability&) {
+		Window* w = fresh();
+		feed(w, "\033[7m\033[3;3HA");
+		return expect(w->screen.row(2)[2].attr & A_REVERSE, "attribute lost when moving");
+	}},
+	{"it", [](const capability& c) { return moves_to("\r\t", Y, c.num); }},
+	{"colors", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(caps["setaf"].str, c.num - 1) + "A");
+		return palette_is(w, false, c.num - 1);
+	}},
+
+	// Attributes and colors
+	{"blink", [](const capability& c) { return starts_attr(c.str, A_BLINK); }},
+	{"bold", [](const capability& c) { return starts_attr(c.str, A_BOLD); }},
+	{"dim", [](const capability& c) { return starts_attr(c.str, A_DIM); }},
+	{"rev", [](const capability& c) { return starts_attr(c.str, A_REVERSE); }},
+	{"sitm", [](const capability& c) { return starts_attr(c.str, A_ITALIC); }},
+	{"smso", [](const capability& c) { return starts_attr(c.str, A_REVERSE); }},
+	{"smul", [](const capability& c) { return starts_attr(c.str, A_UNDERLINE); }},
+	{"ritm", [](const capability& c) { return ends_attr(c.str, "\033[3m", A_ITALIC); }},
+	{"rmso", [](const capability& c) { return ends_attr(c.str, "\033[7m", A_REVERSE); }},
+	{"rmul", [](const capability& c) { return ends_attr(c.str, "\033[4m", A_UNDERLINE); }},
+	{"sgr0", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033[1;4;7;31m\033(0" + c.str + "q");
+		const cell& drawn = w->screen.row(Y)[X];
+		return expect(drawn.ch == 'q' && drawn.attr == 0 && drawn.pair == 0, "attributes, colors or line drawing still set");
+	}},
+	{"op", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033[31;42m" + c.str + "A");
+		return expect(w->screen.row(Y)[X].pair == 0, "colors still set");
+	}},
+	{"setaf", [](const capability& c) { return set_color(c.str, false); }},
+	{"setab", [](const capability& c) { return set_color(c.str, true); }},
+	{"setrgbf", [](const capability& c) { return rgb_color(c.str, false); }},
+	{"setrgbb", [](const capability& c) { return rgb_color(c.str, true); }},
+	{"acsc", [](const capability& c) {
+		for (size_t i = 0; i + 1 < c.str.length(); i += 2) {
+			Window* w = fresh();
+			feed(w, "\033(0" + c.str.substr(i + 1, 1));
+			std::string r = line_drawing(w, c.str[i]);
+			if (!r.empty())
+				return r;
+		}
+		return std::string();
+	}},
+	{"smacs", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str + "q");
+		return line_drawing(w, 'q');
+	}},
+	{"rmacs", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033(0" + c.str + "q");
+		return cell_is(w, Y, X, 'q');
+	}},
+
+	// Cursor movement
+	{"cbt", [](const capability& c) { return moves_to(c.str, Y, 8); }},
+	{"cr", [](const capability& c) { return moves_to(c.str, Y, 0); }},
+	{"cub", [](const capability& c) { return moves_to(expand(c.str, 3), Y, X - 3); }},
+	{"cub1", [](const capability& c) { return moves_to(c.str, Y, X - 1); }},
+	{"cud", [](const capability& c) { return moves_to(expand(c.str, 3), Y + 3, X); }},
+	{"cud1", [](const capability& c) { return moves_to(c.str, Y + 1, X); }},
+	{"cuf", [](const capability& c) { return moves_to(expand(c.str, 3), Y, X + 3); }},
+	{"cuf1", [](const capability& c) { return moves_to(c.str, Y, X + 1); }},
+	{"cup", [](const capability& c) { return moves_to(expand(c.str, 3, 4), 3, 4); }},
+	{"cuu", [](const capability& c) { return moves_to(expand(c.str, 3), Y - 3, X); }},
+	{"cuu1", [](const capability& c) { return moves_to(c.str, Y - 1, X); }},
+	{"home", [](const capability& c) { return moves_to(c.str, 0, 0); }},
+	{"hpa", [](const capability& c) { return moves_to(expand(c.str, 20), Y, 20); }},
+	{"vpa", [](const capability& c) { return moves_to(expand(c.str, 12), 12, X); }},
+	{"ht", [](const capability& c) { return moves_to(c.str, Y, 16); }},
+	{"hts", [](const capability& c) { return moves_to("\033[" + std::to_string(Y + 1) + ";4H" + c.str + "\r\t", Y, 3); }},
+	{"tbc", [](const capability& c) { return moves_to(c.str + "\r\t", Y, 77); }},
+	{"sc", [](const capability& c) { return moves_to(c.str + "\033[2;2H" + caps["rc"].str, Y, X); }},
+	{"rc", [](const capability& c) { return moves_to(caps["sc"].str + "\033[2;2H" + c.str, Y, X); }},
+
+	// Editing
+	{"clear", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({cursor_at(w, 0, 0), row_blank(w, 0), row_blank(w, w->screen.height - 1)});
+	}},
+	{"dch", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({cell_is(w, Y, X, pattern(Y, X + 2)), cell_is(w, Y, X - 1, pattern(Y, X - 1)), blank(w, Y, w->screen.width - 1), cursor_at(w, Y, X)});
+	}},
+	{"dch1", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({cell_is(w, Y, X, pattern(Y, X + 1)), blank(w, Y, w->screen.width - 1), cursor_at(w, Y, X)});
+	}},
+	{"ich", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({blank(w, Y, X), blank(w, Y, X + 1), cell_is(w, Y, X + 2, pattern(Y, X)), cursor_at(w, Y, X)});
+	}},
+	{"ich1", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({blank(w, Y, X), cell_is(w, Y, X + 1, pattern(Y, X)), cursor_at(w, Y, X)});
+	}},
+	{"dl", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({row_from(w, Y, Y + 2), row_from(w, Y - 1, Y - 1), row_blank(w, w->screen.height - 1)});
+	}},
+	{"dl1", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({row_from(w, Y, Y + 1), row_blank(w, w->screen.height - 1)});
+	}},
+	{"il", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({row_blank(w, Y), row_blank(w, Y + 1), row_from(w, Y + 2, Y), row_from(w, Y - 1, Y - 1)});
+	}},
+	{"il1", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({row_blank(w, Y), row_from(w, Y + 1, Y)});
+	}},
+	{"ech", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 3));
+		return all({blank(w, Y, X), blank(w, Y, X + 2), cell_is(w, Y, X + 3, pattern(Y, X + 3)), cursor_at(w, Y, X)});
+	}},
+	{"ed", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({blank(w, Y, X), row_blank(w, w->screen.height - 1), cell_is(w, Y, X - 1, pattern(Y, X - 1)), row_from(w, Y - 1, Y - 1)});
+	}},
+	{"el", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return all({blank(w, Y, X), blank(w, Y, w->screen.width - 1), cell_is(w, Y, X - 1, pattern(Y, X - 1)), row_from(w, Y + 1, Y + 1)});
+	}},
+	{"rep", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 'Z', 3));
+		return all({cell_is(w, Y, X, 'Z'), cell_is(w, Y, X + 2, 'Z'), cell_is(w, Y, X + 3, pattern(Y, X + 3)), cursor_at(w, Y, X + 3)});
+	}},
+	{"smir", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str + "Z");
+		return all({cell_is(w, Y, X, 'Z'), cell_is(w, Y, X + 1, pattern(Y, X)), cursor_at(w, Y, X + 1)});
+	}},
+	{"rmir", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033[4h" + c.str + "Z");
+		return all({cell_is(w, Y, X, 'Z'), cell_is(w, Y, X + 1, pattern(Y, X + 1))});
+	}},
+
+	// Scrolling
+	{"csr", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2, 10) + "\033[11;1H\n");
+		return all({expect(w->screen.top == 2 && w->screen.bot == 10, "scrolling region not set"), row_from(w, 9, 10), row_blank(w, 10), row_from(w, 11, 11)});
+	}},
+	{"ind", [](const capability& c) {
+		Window* w = fresh();
+		int bot = w->screen.height - 1;
+		w->screen.move(bot, X);
+		feed(w, c.str);
+		return all({row_from(w, bot - 1, bot), row_blank(w, bot), cursor_at(w, bot, X)});
+	}},
+	{"indn", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({row_from(w, 0, 2), row_blank(w, w->screen.height - 1), cursor_at(w, Y, X)});
+	}},
+	{"ri", [](const capability& c) {
+		Window* w = fresh();
+		w->screen.move(0, X);
+		feed(w, c.str);
+		return all({row_from(w, 1, 0), row_blank(w, 0), cursor_at(w, 0, X)});
+	}},
+	{"rin", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 2));
+		return all({row_from(w, 2, 0), row_blank(w, 0), cursor_at(w, Y, X)});
+	}},
+
+	// Modes
+	{"smam", [](const capability& c) {
+		Window* w = fresh();
+		w->screen.move(Y, w->screen.width - 2);
+		feed(w, "\033[?7l" + c.str + "ABC");
+		return cell_is(w, Y + 1, 0, 'C');
+	}},
+	{"rmam", [](const capability& c) {
+		Window* w = fresh();
+		w->screen.move(Y, w->screen.width - 2);
+		feed(w, c.str + "ABC");
+		return all({cell_is(w, Y, w->screen.width - 1, 'C'), row_from(w, Y + 1, Y + 1)});
+	}},
+	{"smcup", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return blank(w, Y, X);
+	}},
+	{"rmcup", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, caps["smcup"].str + "Q" + c.str);
+		return cell_is(w, Y, X, pattern(Y, X));
+	}},
+	{"civis", [](const capability& c) { return mode_is(c.str, "?25", 2); }},
+	{"cnorm", [](const capability& c) { return mode_is("\033[?25l" + c.str, "?25", 1); }},
+	{"smkx", [](const capability& c) { return status_is(c.str, APP_CURSOR, true); }},
+	{"rmkx", [](const capability& c) { return status_is("\033[?1h" + c.str, APP_CURSOR, false); }},
+	{"BE", [](const capability& c) { return status_is(c.str, BRACKETED_PASTE, true); }},
+	{"BD", [](const capability& c) { return status_is("\033[?2004h" + c.str, BRACKETED_PASTE, false); }},
+	{"fe", [](const capability& c) { return status_is(c.str, REPORT_FOCUS, true); }},
+	{"fd", [](const capability& c) { return status_is("\033[?1004h" + c.str, REPORT_FOCUS, false); }},
+	{"Sync", [](const capability& c) {
+		return all({status_is(expand(c.str, 1), SYNCHRONIZED, true), status_is(expand(c.str, 1) + expand(c.str, 2), SYNCHRONIZED, false)});
+	}},
+	{"XM", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, expand(c.str, 1));
+		std::string on = expect(w->mouse_mode == 1000, "mouse reporting not started");
+		feed(w, expand(c.str, 0));
+		return all({on, expect(w->mouse_mode == 0, "mouse reporting not stopped")});
+	}},
+
+	// Replies and input
+	{"bel", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return expect(w->ring_bell(), "bell not rung");
+	}},
+	{"u7", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		return expect(matches_report(reply(w), caps["u6"].str, {Y, X}), "reply does not match u6");
+	}},
+	{"u9", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, c.str);
+		std::string r = reply(w);
+		// u8 is \E[?%[;0123456789]c
+		bool ok = r.length() > 4 && r.compare(0, 3, "\033[?") == 0 && r.back() == 'c' && r.find_first_not_of(";0123456789", 3) == r.length() - 1;
+		return expect(ok, "reply does not match u8");
+	}},
+	{"PS", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033[?2004h");
+		w->paste("x", PASTE_START | PASTE_END);
+		return expect(reply(w) == c.str + "x" + caps["PE"].str, "paste not bracketed with PS and PE");
+	}},
+	{"PE", [](const capability& c) {
+		Window* w = fresh();
+		feed(w, "\033[?2004h");
+		w->paste("x", PASTE_START | PASTE_END);
+		return expect(reply(w) == caps["PS"].str + "x" + c.str, "paste not bracketed with PS and PE");
+	}},
+};
+
+// Entries of a terminfo source file, with the names and types of their capabilities
+std::vector<std::pair<std::string, std::vector<capability>>> read_entries(const char* path) {
+	std::vector<std::pair<std::string, std::vector<capability>>> entries;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#')
+			continue;
+		if (line[0] != '\t' && line[0] != ' ') {
+			entries.push_back({line.substr(0, line.find('|')), {}});
+			continue;
+		}
+		if (entries.empty())
+			continue;
+		// Capabilities are separated by commas not escaped by a backslash
+		std::string field;
+		for (size_t i = 0; i < line.length(); i++) {
+			if (line[i] == '\\' && i + 1 < line.length()) {
+				field += line.substr(i++, 2);
+				continue;
+			}
+			if (line[i] != ',') {
+				field += line[i];
+				continue;
+			}
+			field.erase(0, field.find_first_not_of(" \t"));
+			size_t end = field.find_first_of("=#");
+			std::string name = field.substr(0, end);
+			if (!name.empty() && name != "use" && name.back() != '@')
+				entries.back().second.push_back({name, (end == std::string::npos) ? '!' : field[end], ""});
+			field.clear();
+		}
+	}
+	return entries;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s <rwm.terminfo> <compiled terminfo directory>\n", argv[0]);
+		return 2;
+	}
+	auto entries = read_entries(argv[1]);
+
+	// Values are read with the entry's own terminfo; the windows then draw for an xterm that is never shown
+	FILE* null_out = fopen("/dev/null", "w");
+	FILE* null_in = fopen("/dev/null", "r");
+	std::vector<std::map<std::string, capability>> values;
+	setenv("TERMINFO", argv[2], 1);
+	for (size_t e = 0; e < entries.size(); e++) {
+		SCREEN* entry = newterm(entries[e].first.c_str(), null_out, null_in);
+		if (!entry) {
+			fprintf(stderr, "%s: entry not found in %s\n", entries[e].first.c_str(), argv[2]);
+			return 1;
+		}
+		values.emplace_back();
+		// An entry has the capabilities of the entries it uses as well (which come before it in the file)
+		for (size_t i = 0; i <= e; i++) {
+			for (capability c : entries[i].second) {
+				if (c.type == '=') {
+					char* s = tigetstr((char*) c.name.c_str());
+					if (!s || s == (char*) -1)
+						continue;
+					c.str = s;
+				} else if (c.type == '#') {
+					c.num = tigetnum((char*) c.name.c_str());
+				}
+				if (i == e || values.back().count(c.name) == 0)
+					values.back()[c.name] = c;
+			}
+		}
+		endwin();
+		delscreen(entry);
+	}
+	unsetenv("TERMINFO");
+
+	setlocale(LC_CTYPE, "C.UTF-8");
+	if (!newterm("xterm-256color", null_out, null_in)) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	init_colors();
+
+	if (openpty(&master, &slave, nullptr, nullptr, nullptr) == -1) {
+		perror("openpty");
+		return 1;
+	}
+	termios raw;
+	tcgetattr(slave, &raw);
+	cfmakeraw(&raw);
+	tcsetattr(slave, TCSANOW, &raw);
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	fcntl(slave, F_SETFL, O_NONBLOCK);
+
+	std::vector<std::string> failures;
+	for (size_t e = 0; e < entries.size(); e++) {
+		caps = values[e];
+		for (auto& [name, cap] : caps) {
+			auto check = checks.find(name);
+			std::string result;
+			if (check != checks.end())
+				result = check->second(cap);
+			else if (name[0] != 'k' && not_output.count(name) == 0)
+				result = "not checked; add a check to tests/terminfo_check.cpp or remove it from the entry";
+			if (!result.empty())
+				failures.push_back(entries[e].first + ": " + name + ": " + result);
+		}
+	}
+	endwin();
+
+	for (const std::string& f : failures)
+		fprintf(stderr, "%s\n", f.c_str());
+	if (failures.empty())
+		printf("terminfo_check: all capabilities of %zu entries checked\n", entries.size());
+	return failures.empty() ? 0 : 1;
+}
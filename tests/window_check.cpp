@@ -0,0 +1,316 @@
+// Checks how windows are laid out on the screen and what they show: which window is on top where
+// (get_top_window) and how many cells each one shows when they overlap, also right after one was moved,
+// and that a partly covered window does not draw over the windows above it. Output that skips work
+// (jump scrolling, coalescing rewrites of a line) must end on the same screen as output that does not.
+// A synchronized update is not shown until it ends or sync_timeout has passed. Sequences and strings split
+// across reads work as if they had come in one piece.
+//
+// Usage: window_check
+#include <ncurses.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <locale.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "../source/windows.hpp"
+#include "../source/rwm.h"
+
+using namespace rwm;
+
+// Window reading its output from a pipe, as if a process wrote it
+Window* open_window(int lines, int cols, int y, int x) {
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		exit(1);
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	Window* w = new Window(newwin(lines, cols, y, x), "check", 0, fds[0], fds[1]);
+	w->shown_cells = 0;
+	return w;
+}
+
+void feed(Window* w, const std::string& s) {
+	if (write(w->slave, s.data(), s.length()) != (ssize_t) s.length())
+		perror("write");
+	w->readable = true;
+	w->receive();
+	w->decode(SIZE_MAX);
+	w->apply();
+	init_new_colors();
+}
+
+// Text of row y of the window's screen buffer
+std::string row_text(Window* w, int y) {
+	std::string s;
+	for (int x = 0; x < w->screen.width; x++)
+		s += (char) w->screen.row(y)[x].ch;
+	return s;
+}
+
+// Whether both windows have the same cells and cursor; says where they differ otherwise
+std::string compare(Window* a, Window* b) {
+	if (a->screen.y != b->screen.y || a->screen.x != b->screen.x)
+		return "cursor at " + std::to_string(a->screen.y) + "," + std::to_string(a->screen.x) + " and "
+		     + std::to_string(b->screen.y) + "," + std::to_string(b->screen.x);
+	for (int y = 0; y < a->screen.height; y++)
+		for (int x = 0; x < a->screen.width; x++)
+			if (a->screen.row(y)[x] != b->screen.row(y)[x])
+				return "cells differ at " + std::to_string(y) + "," + std::to_string(x) + ": row " + row_text(a, y) + " and " + row_text(b, y);
+	return "";
+}
+
+// Character ncurses would show at (y, x) after the next doupdate
+char shown_char(int y, int x) {
+	return mvwinch(newscr, y, x) & A_CHARTEXT;
+}
+
+std::string check_layout() {
+	// a at (0, 0), b over its lower right part, c over b but hidden
+	Window* a = open_window(10, 20, 0, 0);
+	Window* b = open_window(10, 20, 5, 10);
+	Window* c = open_window(4, 4, 6, 12);
+	c->status |= HIDDEN;
+	windows = {a, b, c};
+	update_layout();
+	if (a->shown_cells != 150 || b->shown_cells != 200 || c->shown_cells != 0)
+		return "shown cells " + std::to_string(a->shown_cells) + ", " + std::to_string(b->shown_cells) + ", "
+		     + std::to_string(c->shown_cells) + " instead of 150, 200, 0";
+	if (get_top_window({1, 1}) != 0 || get_top_window({5, 5}) != 0 || get_top_window({7, 13}) != 1 || get_top_window({20, 70}) != -1)
+		return "wrong window on top";
+	if (update_layout())
+		return "layout rebuilt though nothing changed";
+
+	// The lookup sees a move before the main loop does, and the main loop still learns of it
+	b->move({0, 0});
+	if (get_top_window({1, 1}) != 1)
+		return "moved window not on top where it was moved to";
+	if (!update_layout() || update_layout())
+		return "rebuild for the lookup not reported once";
+	if (a->shown_cells != 0 || b->shown_cells != 200)
+		return "shown cells after the move " + std::to_string(a->shown_cells) + ", " + std::to_string(b->shown_cells) + " instead of 0, 200";
+
+	// Restacking and hiding are seen as well: a goes over b and c, then is hidden
+	c->status &= ~HIDDEN;
+	move_to_top(0);
+	if (get_top_window({1, 1}) != 2 || get_top_window({7, 13}) != 2)
+		return "restacked window not on top";
+	a->status |= HIDDEN;
+	invalidate_layout();
+	if (get_top_window({1, 1}) != 0 || get_top_window({7, 13}) != 1)
+		return "hidden window still on top";
+	windows.clear();
+	return "";
+}
+
+std::string check_covered_render() {
+	Window* a = open_window(10, 20, 0, 0);
+	Window* b = open_window(10, 20, 5, 10);
+	b->status |= HIDDEN;
+	windows = {a, b};
+	std::string fill;
+	for (int y = 0; y < 8; y++)
+		fill += std::string(18, 'a') + (y < 7 ? "\r\n" : "");
+	feed(a, fill);
+	update_layout();
+	a->render(false);
+
+	// a draws only what b leaves of it; its own cells under b still hold the a's drawn before
+	b->status &= ~HIDDEN;
+	update_layout();
+	feed(b, "\033[2J\033[H" + std::string(18 * 8, 'b'));
+	b->render(true);
+	feed(a, "\033[H" + std::string(18, 'A'));
+	a->render(false);
+	if (row_text(a, 0) != std::string(18, 'A'))
+		return "a: first row " + row_text(a, 0);
+	if (shown_char(1, 1) != 'A' || shown_char(7, 12) != 'b' || shown_char(8, 18) != 'b')
+		return std::string("screen shows ") + shown_char(1, 1) + shown_char(7, 12) + shown_char(8, 18) + " instead of Abb";
+	windows.clear();
+	return "";
+}
+
+// Colored numbered lines, as many as `n`
+std::string flood(int n, int seed) {
+	std::string s;
+	for (int i = 0; i < n; i++)
+		s += "\033[3" + std::to_string((seed + i) % 8) + "mline " + std::to_string(seed + i) + "\033[m " + std::string(i % 50, '.') + "\r\n";
+	return s;
+}
+
+std::string check_jump_scroll() {
+	// Both windows get the same passes; in the first and the last, a flood of lines (which jump scrolling skips
+	// most of) is followed by lines that scroll inside a scrolling region (which it must not skip)
+	Window* all = open_window(24, 80, 0, 0);
+	Window* jump = open_window(24, 80, 0, 0);
+	all->jump_scroll = 0;
+	jump->jump_scroll = 2;
+	std::vector<std::string> passes = {
+		flood(300, 0) + "\033[5;15r\033[15;1H" + flood(40, 300),
+		flood(40, 340) + "\033[r\033[24;1H" + flood(100, 380),
+		flood(300, 480) + "\033[3;20r\033[1;20r\033[20;1H" + flood(30, 780) + "\033[Mmore\033[2Lend",
+	};
+	for (const std::string& pass : passes) {
+		feed(all, pass);
+		feed(jump, pass);
+	}
+	return compare(all, jump);
+}
+
+// Feeds `s` one byte per pass, so nothing is coalesced
+void feed_bytes(Window* w, const std::string& s) {
+	for (char c : s)
+		feed(w, std::string(1, c));
+}
+
+std::string check_coalesce() {
+	struct example {
+		std::string stream;
+		std::string row;                // First row afterwards
+	};
+	std::vector<example> examples = {
+		// Partly overwritten rewrites stay
+		{"\rabcdefgh\rxy\r12345", "12345fgh"},
+		// The colors of a rewrite that is dropped still apply
+		{"\r\033[1mabc\r\033[22;31mxyz", "xyz"},
+		// The bold d to h stay; a rewrite that is not fully overwritten must not be dropped
+		{"\r\033[1mabcdefgh\r\033[22mxy\r123", "123defgh"},
+		// Rewrites of other lines, and a line that wrapped, are not overwritten
+		{"\rabcdef\n\rxyz\033[A\rq", "qbcdef"},
+		{"\r" + std::string(80, 'w') + "\r" + std::string(80, 'v'), std::string(78, 'w')},
+		{"\rabcdef\033[K\rxy\033[K\rxyz", "xyz"},
+	};
+	for (example& e : examples) {
+		Window* pass = open_window(24, 80, 0, 0);
+		Window* bytes = open_window(24, 80, 0, 0);
+		feed(pass, "\033[2J\033[H");
+		feed(bytes, "\033[2J\033[H");
+		feed(pass, e.stream);
+		feed_bytes(bytes, e.stream);
+		std::string row = row_text(pass, 0);
+		row.erase(row.find_last_not_of(' ') + 1);
+		if (row != e.row)
+			return "first row " + row + " instead of " + e.row;
+		std::string diff = compare(pass, bytes);
+		if (!diff.empty())
+			return "with and without coalescing, " + diff;
+	}
+
+	// Progress bars: colored rewrites of the same line of changing length, with erases and now and then a new line
+	srand(1);
+	Window* pass = open_window(24, 80, 0, 0);
+	Window* bytes = open_window(24, 80, 0, 0);
+	std::string stream;
+	for (int i = 0; i < 2000; i++) {
+		stream += (rand() % 40 == 0) ? "\r\n" : "\r";
+		if (rand() % 3 == 0)
+			stream += "\033[" + std::to_string(rand() % 2) + ";3" + std::to_string(rand() % 8) + "m";
+		stream += std::string(rand() % 30, '#') + std::to_string(i);
+		if (rand() % 4 == 0)
+			stream += "\033[K";
+	}
+	feed(pass, stream);
+	feed_bytes(bytes, stream);
+	return compare(pass, bytes);
+}
+
+// Text of row y of win as ncurses has it
+std::string drawn_text(Window* w, int y, int n) {
+	std::string s;
+	for (int x = 0; x < n; x++)
+		s += (char) (mvwinch(w->win, y, x) & A_CHARTEXT);
+	return s;
+}
+
+std::string check_sync() {
+	Window* w = open_window(24, 80, 0, 0);
+	windows = {w};
+	update_layout();
+	feed(w, "\033[2J\033[Hbefore");
+	w->render(true);
+
+	// Nothing of the update is shown before it ends, however often the window is rendered
+	feed(w, "\033[?2026h\033[2J\033[Hhalf");
+	w->render(true);
+	feed(w, " done");
+	w->render(true);
+	if (!(w->status & SYNCHRONIZED) || drawn_text(w, 0, 9) != "before   ")
+		return "shown during the update: " + drawn_text(w, 0, 9);
+	if (expire_sync(w))
+		return "update ended before sync_timeout";
+	feed(w, "\033[?2026l");
+	w->render(true);
+	if ((w->status & SYNCHRONIZED) || drawn_text(w, 0, 9) != "half done")
+		return "not shown after the update ended: " + drawn_text(w, 0, 9);
+
+	// An update that is never ended is shown once sync_timeout has passed
+	int timeout = sync_timeout;
+	sync_timeout = 20;
+	feed(w, "\033[?2026h\033[Hstuck");
+	w->render(true);
+	std::string during = drawn_text(w, 0, 9);
+	timespec wait = {0, 30 * 1000000L};
+	nanosleep(&wait, nullptr);
+	bool expired = expire_sync(w);
+	w->render(true);
+	sync_timeout = timeout;
+	windows.clear();
+	if (during != "half done")
+		return "shown during the unfinished update: " + during;
+	if (!expired || (w->status & SYNCHRONIZED) || drawn_text(w, 0, 9) != "stuckdone")
+		return "not shown after sync_timeout: " + drawn_text(w, 0, 9);
+	return "";
+}
+
+std::string check_split() {
+	Window* w = open_window(24, 80, 0, 0);
+	feed(w, "\033]0;first ti");
+	feed(w, "tle\033]2;sec");
+	feed(w, "ond\033");
+	feed(w, "\\\033[2J\033[?");
+	feed(w, "7l\033[Hé\033[");
+	feed(w, "3b");
+	if (w->title != "second")
+		return "title " + w->title + " instead of second";
+	if (w->screen.x != 4)
+		return "cursor at column " + std::to_string(w->screen.x) + " instead of 4";
+	feed(w, std::string(100, 'x'));
+	if (w->screen.y != 0)
+		return "line wrap still on";
+	return "";
+}
+
+int main() {
+	setlocale(LC_CTYPE, "C.UTF-8");
+	if (!newterm("xterm-256color", fopen("/dev/null", "w"), fopen("/dev/null", "r"))) {
+		fprintf(stderr, "xterm-256color: entry not found\n");
+		return 1;
+	}
+	resizeterm(40, 100);
+	init_colors();
+
+	std::vector<std::pair<std::string, std::string (*)()>> checks = {
+		{"overlapping windows", check_layout},
+		{"partly covered window", check_covered_render},
+		{"jump scrolling", check_jump_scroll},
+		{"coalesced rewrites", check_coalesce},
+		{"synchronized output", check_sync},
+		{"split sequences", check_split},
+	};
+	std::vector<std::string> failures;
+	for (auto& [name, check] : checks) {
+		std::string result = check();
+		if (!result.empty())
+			failures.push_back(name + ": " + result);
+	}
+	endwin();
+
+	for (const std::string& f : failures)
+		fprintf(stderr, "window_check: %s\n", f.c_str());
+	if (failures.empty())
+		printf("window_check: %zu checks passed\n", checks.size());
+	return failures.empty() ? 0 : 1;
+}